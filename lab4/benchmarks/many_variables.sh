@@ -0,0 +1,19 @@
+#! /bin/sh
+# Write a Tiger program declaring 100000 variables, one in a hundred
+# of them escaping into a function, to measure the throughput of the
+# code generator on the lookups of its side tables:
+#   sh many_variables.sh > many_variables.tig
+#   time dtiger --irgen many_variables.tig
+n=${1:-100000}
+awk -v n="$n" 'BEGIN {
+  print "let var v0 := 0"
+  for (i = 1; i < n; i++)
+    printf "    var v%d := v%d + 1\n", i, i - 1
+  printf "    function escaping() : int = 0"
+  for (i = 0; i < n; i += 100)
+    printf " + v%d", i
+  print ""
+  printf "in print_int(v%d + escaping());\n", n - 1
+  print "   print(\"\\n\")"
+  print "end"
+}'
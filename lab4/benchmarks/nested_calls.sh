@@ -0,0 +1,19 @@
+#! /bin/sh
+# Write a Tiger program applying concat 5000 times to a variable and
+# literals, which cannot be folded at compile time although every
+# literal can, to measure how the code generator folds constants:
+#   sh nested_calls.sh > nested_calls.tig
+#   time dtiger --irgen nested_calls.tig
+n=${1:-5000}
+awk -v n="$n" 'BEGIN {
+  print "let var s := \"x\""
+  printf "in print("
+  for (i = 0; i < n; i++)
+    printf "concat("
+  printf "s"
+  for (i = 0; i < n; i++)
+    printf ", \"a\")"
+  print ");"
+  print "   print(\"\\n\")"
+  print "end"
+}'
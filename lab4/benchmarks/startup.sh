@@ -0,0 +1,33 @@
+#! /bin/sh
+# Measure the latency of running a tiny program from its source,
+# either by building an executable and running it, or in-process
+# with the JIT or the AST interpreter:
+#   sh startup.sh [dtiger [runs]]
+dtiger=${1:-dtiger}
+runs=${2:-20}
+program=$(dirname "$0")/hello.tig
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# Run a command the given number of times and print the mean time
+# taken by a run.
+time_runs() {
+  label=$1
+  shift
+  start=$(date +%s%N)
+  i=0
+  while [ $i -lt "$runs" ]; do
+    "$@" > /dev/null || exit 1
+    i=$((i + 1))
+  done
+  end=$(date +%s%N)
+  echo "$label: $(((end - start) / runs / 1000)) us per run"
+}
+
+build_and_run() {
+  "$dtiger" --executable "$tmp/hello" "$program" && "$tmp/hello"
+}
+
+time_runs executable build_and_run
+time_runs jit "$dtiger" --run "$program"
+time_runs interpreter "$dtiger" --interpret "$program"
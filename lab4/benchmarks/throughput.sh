@@ -0,0 +1,26 @@
+#! /bin/sh
+# Compare the time taken to run fibonacci.tig from its source by
+# the AST interpreter, by the JIT and as an executable:
+#   sh throughput.sh [dtiger]
+dtiger=${1:-dtiger}
+program=$(dirname "$0")/fibonacci.tig
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# Run a command and print the time it took.
+time_run() {
+  label=$1
+  shift
+  start=$(date +%s%N)
+  "$@" > /dev/null || exit 1
+  end=$(date +%s%N)
+  echo "$label: $(((end - start) / 1000000)) ms"
+}
+
+build_and_run() {
+  "$dtiger" --executable "$tmp/fibonacci" "$program" && "$tmp/fibonacci"
+}
+
+time_run interpreter "$dtiger" --interpret "$program"
+time_run jit "$dtiger" --run "$program"
+time_run executable build_and_run
@@ -0,0 +1,284 @@
+#include <fstream>
+#include <iterator>
+
+#include "bytecode.hh"
+#include "../runtime/runtime.hh"
+#include "../utils/errors.hh"
+
+// A bytecode file starts with a magic number, followed by the
+// string table and the functions. Every number is stored as 4
+// little-endian bytes, and every string as its length followed by
+// its bytes. A function is its name, the index of its parent, its
+// numbers of parameters and registers, and its code.
+
+namespace bytecode {
+
+namespace {
+
+const char magic[] = {'T', 'B', 'C', '2'};
+
+const int32_t opcode_count = 0
+#define BYTECODE_OPCODE(name) +1
+    BYTECODE_OPCODES(BYTECODE_OPCODE)
+#undef BYTECODE_OPCODE
+    ;
+
+// Number of arguments of every primitive.
+const int32_t primitive_arity[] = {1, 1, 1, 0, 0, 1, 1, 1, 3, 2, 2, 2, 1, 1};
+
+// Number of words of an instruction, including its opcode.
+int32_t instruction_size(int32_t opcode) {
+  switch (opcode) {
+  case op_JUMP:
+  case op_RETURN:
+    return 2;
+  case op_CONST:
+  case op_STRING:
+  case op_MOVE:
+  case op_JUMP_IF_FALSE:
+  case op_JUMP_IF_TRUE:
+    return 3;
+  case op_CALL:
+    return 5;
+  default:
+    return 4;
+  }
+}
+
+class Writer {
+  std::ofstream out;
+
+public:
+  explicit Writer(const std::string &filename)
+      : out(filename, std::ios::binary) {
+    if (!out)
+      utils::error("cannot open " + filename);
+  }
+
+  void bytes(const char *b, size_t count) { out.write(b, count); }
+
+  void word(int32_t w) {
+    const uint32_t u = w;
+    const char bytes[] = {char(u), char(u >> 8), char(u >> 16), char(u >> 24)};
+    out.write(bytes, sizeof(bytes));
+  }
+
+  void string(const std::string &s) {
+    word(s.size());
+    out.write(s.data(), s.size());
+  }
+};
+
+class Reader {
+  const std::string filename;
+  std::string data;
+  size_t position = 0;
+
+  void need(size_t count) {
+    if (count > data.size() - position)
+      utils::error(filename + ": truncated bytecode file");
+  }
+
+public:
+  explicit Reader(const std::string &_filename) : filename(_filename) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in)
+      utils::error("cannot open " + filename);
+    data.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+  }
+
+  void check_magic() {
+    need(sizeof(magic));
+    if (data.compare(0, sizeof(magic), magic, sizeof(magic)))
+      utils::error(filename + ": not a bytecode file");
+    position += sizeof(magic);
+  }
+
+  int32_t word() {
+    need(4);
+    const unsigned char *const bytes =
+        reinterpret_cast<const unsigned char *>(data.data() + position);
+    position += 4;
+    return uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 |
+           uint32_t(bytes[2]) << 16 | uint32_t(bytes[3]) << 24;
+  }
+
+  // Read a count of items, each at least size bytes long.
+  size_t count(size_t size) {
+    const uint32_t n = word();
+    need(n * size);
+    return n;
+  }
+
+  std::string string() {
+    const size_t length = count(1);
+    position += length;
+    return data.substr(position - length, length);
+  }
+
+  [[noreturn]] void invalid() {
+    utils::error(filename + ": invalid bytecode");
+  }
+};
+
+// Return the function levels declarations above a function, or -1
+// if there is none.
+int32_t enclosing(const Program &program, int32_t function, int32_t levels) {
+  for (; levels > 0 && function >= 0; levels--)
+    function = program.functions[function].parent;
+  return function;
+}
+
+// Check that every operand of a function stays within the program,
+// so that the virtual machine does not have to. Static links are
+// followed through the parents of the functions, so the frame
+// found levels up from a function is that of the function declaring
+// it that many levels up.
+void verify(Reader &reader, const Program &program, int32_t index) {
+  const Function &f = program.functions[index];
+  if (f.params < 0 || f.registers <= f.params)
+    reader.invalid();
+  const std::vector<int32_t> &code = f.code;
+  std::vector<bool> starts(code.size());
+  size_t last = 0;
+  for (size_t pc = 0; pc < code.size(); pc += instruction_size(code[pc])) {
+    if (code[pc] < 0 || code[pc] >= opcode_count ||
+        pc + instruction_size(code[pc]) > code.size())
+      reader.invalid();
+    starts[pc] = true;
+    last = pc;
+  }
+  if (code.empty() || code[last] != op_RETURN)
+    reader.invalid();
+
+  // Computed in 64 bits, so that the last register of a range
+  // cannot overflow.
+  auto reg = [&](int64_t r) {
+    if (r < 0 || r >= f.registers)
+      reader.invalid();
+  };
+  auto frame_reg = [&](int32_t levels, int32_t r) {
+    const int32_t g = levels < 0 ? -1 : enclosing(program, index, levels);
+    return g >= 0 && r >= 0 && r < program.functions[g].registers;
+  };
+  auto target = [&](int32_t t) {
+    if (t < 0 || size_t(t) >= code.size() || !starts[t])
+      reader.invalid();
+  };
+  for (size_t pc = 0; pc < code.size(); pc += instruction_size(code[pc])) {
+    const int32_t *const i = &code[pc];
+    switch (i[0]) {
+    case op_CONST: reg(i[1]); break;
+    case op_STRING:
+      reg(i[1]);
+      if (i[2] < 0 || size_t(i[2]) >= program.strings.size())
+        reader.invalid();
+      break;
+    case op_MOVE: reg(i[1]); reg(i[2]); break;
+    case op_LOAD:
+      reg(i[1]);
+      if (!frame_reg(i[2], i[3]))
+        reader.invalid();
+      break;
+    case op_STORE:
+      if (!frame_reg(i[1], i[2]))
+        reader.invalid();
+      reg(i[3]);
+      break;
+    case op_JUMP: target(i[1]); break;
+    case op_JUMP_IF_FALSE:
+    case op_JUMP_IF_TRUE: reg(i[1]); target(i[2]); break;
+    case op_FOR_LOOP:
+    case op_JEQ:
+    case op_JNE:
+    case op_JLT:
+    case op_JLE:
+    case op_JGT:
+    case op_JGE: reg(i[1]); reg(i[2]); target(i[3]); break;
+    case op_CALL: {
+      reg(i[1]);
+      if (i[2] < 0 || size_t(i[2]) >= program.functions.size() || i[3] < 0)
+        reader.invalid();
+      const Function &callee = program.functions[i[2]];
+      if (callee.parent < 0 ||
+          enclosing(program, index, i[3]) != callee.parent)
+        reader.invalid();
+      const int32_t params = callee.params;
+      if (params) {
+        reg(i[4]);
+        reg(int64_t(i[4]) + params - 1);
+      }
+      break;
+    }
+    case op_PRIM:
+      reg(i[1]);
+      if (i[2] < 0 || i[2] > runtime::p_exit)
+        reader.invalid();
+      if (primitive_arity[i[2]]) {
+        reg(i[3]);
+        reg(int64_t(i[3]) + primitive_arity[i[2]] - 1);
+      }
+      break;
+    case op_RETURN: reg(i[1]); break;
+    default: reg(i[1]); reg(i[2]); reg(i[3]); break;
+    }
+  }
+}
+
+} // namespace
+
+void save(const Program &program, const std::string &filename) {
+  Writer writer(filename);
+  writer.bytes(magic, sizeof(magic));
+  writer.word(program.strings.size());
+  for (auto &s : program.strings)
+    writer.string(s);
+  writer.word(program.functions.size());
+  for (auto &f : program.functions) {
+    writer.string(f.name);
+    writer.word(f.parent);
+    writer.word(f.params);
+    writer.word(f.registers);
+    writer.word(f.code.size());
+    for (int32_t w : f.code)
+      writer.word(w);
+  }
+}
+
+Program load(const std::string &filename) {
+  Reader reader(filename);
+  reader.check_magic();
+  Program program;
+  program.strings.resize(reader.count(4));
+  for (auto &s : program.strings)
+    s = reader.string();
+  program.functions.resize(reader.count(20));
+  if (program.functions.empty())
+    reader.invalid();
+  for (auto &f : program.functions) {
+    f.name = reader.string();
+    f.parent = reader.word();
+    f.params = reader.word();
+    f.registers = reader.word();
+    f.code.resize(reader.count(4));
+    for (auto &w : f.code)
+      w = reader.word();
+  }
+  // Main is the only function without a parent, and every other
+  // one is declared in main, directly or not.
+  const int32_t count = program.functions.size();
+  for (int32_t k = 0; k < count; k++) {
+    const int32_t parent = program.functions[k].parent;
+    if (k == 0 ? parent != -1 : parent < 0 || parent >= count)
+      reader.invalid();
+  }
+  for (int32_t k = 0; k < count; k++)
+    if (enclosing(program, k, count) != -1)
+      reader.invalid();
+  for (int32_t k = 0; k < count; k++)
+    verify(reader, program, k);
+  return program;
+}
+
+} // namespace bytecode
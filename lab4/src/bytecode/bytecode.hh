@@ -0,0 +1,81 @@
+#ifndef BYTECODE_HH
+#define BYTECODE_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bytecode {
+
+// Every instruction is an opcode word followed by its operands.
+// Registers are numbered from the start of the current frame, and
+// jump targets are offsets in the code of the current function.
+// Comparisons of integers (EQ to GE and JEQ to JGE) keep the order
+// of the AST operators.
+#define BYTECODE_OPCODES(X)                                            \
+  X(CONST)         /* dst value        dst := value */                 \
+  X(STRING)        /* dst index        dst := strings[index] */        \
+  X(MOVE)          /* dst src          dst := src */                   \
+  X(LOAD)          /* dst levels reg   dst := reg, levels frames up */ \
+  X(STORE)         /* levels reg src   reg, levels frames up := src */ \
+  X(ADD)           /* dst a b          dst := a + b */                 \
+  X(SUB)                                                               \
+  X(MUL)                                                               \
+  X(DIV)                                                               \
+  X(EQ)            /* dst a b          dst := a = b */                 \
+  X(NE)                                                                \
+  X(LT)                                                                \
+  X(LE)                                                                \
+  X(GT)                                                                \
+  X(GE)                                                                \
+  X(JUMP)          /* target */                                        \
+  X(JUMP_IF_FALSE) /* cond target */                                   \
+  X(JUMP_IF_TRUE)  /* cond target */                                   \
+  X(JEQ)           /* a b target       jump if a = b */                \
+  X(JNE)                                                               \
+  X(JLT)                                                               \
+  X(JLE)                                                               \
+  X(JGT)                                                               \
+  X(JGE)                                                               \
+  X(FOR_LOOP)      /* index high target                                \
+                      unless index = high, increment index and jump */ \
+  X(CALL)          /* dst function levels args                         \
+                      call with the static link levels frames up,      \
+                      arguments in consecutive registers from args */  \
+  X(PRIM)          /* dst primitive args */                            \
+  X(RETURN)        /* src */
+
+typedef enum {
+#define BYTECODE_OPCODE(name) op_##name,
+  BYTECODE_OPCODES(BYTECODE_OPCODE)
+#undef BYTECODE_OPCODE
+} Opcode;
+
+struct Function {
+  std::string name;
+  // Index of the function declaring this one, whose frame its static
+  // link refers to, or -1 for main.
+  int32_t parent = -1;
+  // Parameters come first in the registers.
+  int32_t params = 0;
+  int32_t registers = 0;
+  std::vector<int32_t> code;
+};
+
+// A whole program, whose first function is main.
+struct Program {
+  std::vector<std::string> strings;
+  std::vector<Function> functions;
+};
+
+// Write a program to a file, or read it back.
+void save(const Program &program, const std::string &filename);
+Program load(const std::string &filename);
+
+// Run a program in the virtual machine, and return the status
+// returned by main.
+int run(const Program &program);
+
+} // namespace bytecode
+
+#endif // BYTECODE_HH
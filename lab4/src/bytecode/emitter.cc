@@ -0,0 +1,302 @@
+#include "emitter.hh"
+#include "../runtime/runtime.hh"
+#include "../utils/errors.hh"
+
+namespace bytecode {
+
+namespace {
+
+// Return true if evaluating an expression cannot change a variable.
+bool is_simple(const Expr &expr) {
+  return dynamic_cast<const IntegerLiteral *>(&expr) ||
+         dynamic_cast<const StringLiteral *>(&expr) ||
+         dynamic_cast<const Identifier *>(&expr);
+}
+
+// Return true if expr is the integer literal value.
+bool is_integer(const Expr &expr, int32_t value) {
+  const IntegerLiteral *const literal =
+      dynamic_cast<const IntegerLiteral *>(&expr);
+  return literal && literal->value == value;
+}
+
+// Comparison jumping when the given one is false.
+Operator negate(Operator op) {
+  switch (op) {
+  case o_eq: return o_neq;
+  case o_neq: return o_eq;
+  case o_lt: return o_ge;
+  case o_le: return o_gt;
+  case o_gt: return o_le;
+  case o_ge: return o_lt;
+  default: return op;
+  }
+}
+
+} // namespace
+
+Program Emitter::emit_program(const FunDecl &main) {
+  function_index(main);
+  while (!pending.empty()) {
+    const FunDecl *const decl = pending.front();
+    pending.pop_front();
+    emit_function(*decl);
+  }
+  return program;
+}
+
+int32_t Emitter::function_index(const FunDecl &decl) {
+  auto f = functions.find(&decl);
+  if (f != functions.end())
+    return f->second;
+  const int32_t parent =
+      decl.get_parent() ? function_index(decl.get_parent().get()) : -1;
+  const int32_t index = program.functions.size();
+  program.functions.emplace_back();
+  program.functions.back().name = decl.get_external_name().get();
+  program.functions.back().parent = parent;
+  program.functions.back().params = decl.get_params().size();
+  functions[&decl] = index;
+  pending.push_back(&decl);
+  return index;
+}
+
+void Emitter::emit_function(const FunDecl &decl) {
+  current = functions[&decl];
+  next_register = 0;
+  for (auto param : decl.get_params())
+    registers[param] = allocate();
+  const int32_t result = allocate();
+  emit_into(*decl.get_expr(), result);
+  emit({op_RETURN, result});
+}
+
+size_t Emitter::emit(std::initializer_list<int32_t> words) {
+  code().insert(code().end(), words);
+  return code().size() - 1;
+}
+
+void Emitter::patch(const std::vector<size_t> &jumps, size_t target) {
+  for (auto jump : jumps)
+    code()[jump] = target;
+}
+
+int32_t Emitter::allocate(int32_t count) {
+  const int32_t first = next_register;
+  next_register += count;
+  Function &function = program.functions[current];
+  if (next_register > function.registers)
+    function.registers = next_register;
+  return first;
+}
+
+void Emitter::emit_into(const Expr &expr, int32_t dst) {
+  destination = dst;
+  expr.accept(*this);
+}
+
+int32_t Emitter::operand(const Expr &expr) {
+  if (auto id = dynamic_cast<const Identifier *>(&expr)) {
+    const VarDecl &decl = id->get_decl().get();
+    if (id->get_depth() == decl.get_depth())
+      return registers[&decl];
+  }
+  const int32_t reg = allocate();
+  emit_into(expr, reg);
+  return reg;
+}
+
+void Emitter::comparison_operands(const BinaryOperator &op, int32_t &a,
+                                  int32_t &b) {
+  if (op.get_left().get_type() == t_string) {
+    // Compare the result of strcmp with 0.
+    a = allocate(2);
+    b = a + 1;
+    emit_into(op.get_left(), a);
+    emit_into(op.get_right(), b);
+    emit({op_PRIM, a, runtime::p_strcmp, a});
+    emit({op_CONST, b, 0});
+    return;
+  }
+  // The left operand is copied unless the right one cannot change
+  // the variable holding it.
+  if (is_simple(op.get_right())) {
+    a = operand(op.get_left());
+  } else {
+    a = allocate();
+    emit_into(op.get_left(), a);
+  }
+  b = operand(op.get_right());
+}
+
+void Emitter::emit_branch_if_false(const Expr &condition,
+                                   std::vector<size_t> &jumps) {
+  const int32_t mark = next_register;
+  if (auto op = dynamic_cast<const BinaryOperator *>(&condition)) {
+    if (op->op >= o_eq) {
+      int32_t a, b;
+      comparison_operands(*op, a, b);
+      jumps.push_back(emit({op_JEQ + negate(op->op) - o_eq, a, b, 0}));
+      next_register = mark;
+      return;
+    }
+  }
+  // The parser turns a & b into if a then (if b then 1 else 0) else 0,
+  // which is false as soon as one of the conditions is.
+  if (auto ite = dynamic_cast<const IfThenElse *>(&condition)) {
+    if (is_integer(ite->get_else_part(), 0)) {
+      emit_branch_if_false(ite->get_condition(), jumps);
+      if (!is_integer(ite->get_then_part(), 1))
+        emit_branch_if_false(ite->get_then_part(), jumps);
+      return;
+    }
+  }
+  const int32_t reg = operand(condition);
+  jumps.push_back(emit({op_JUMP_IF_FALSE, reg, 0}));
+  next_register = mark;
+}
+
+void Emitter::visit(const IntegerLiteral &literal) {
+  emit({op_CONST, destination, literal.value});
+}
+
+void Emitter::visit(const StringLiteral &literal) {
+  const std::string &value = literal.value.get();
+  auto s = strings.find(value);
+  if (s == strings.end()) {
+    s = strings.insert({value, int32_t(program.strings.size())}).first;
+    program.strings.push_back(value);
+  }
+  emit({op_STRING, destination, s->second});
+}
+
+void Emitter::visit(const BinaryOperator &op) {
+  const int32_t dst = destination;
+  const int32_t mark = next_register;
+  int32_t a, b;
+  comparison_operands(op, a, b);
+  emit({op_ADD + op.op, dst, a, b});
+  next_register = mark;
+}
+
+void Emitter::visit(const Sequence &seq) {
+  const int32_t dst = destination;
+  const std::vector<Expr *> &exprs = seq.get_exprs();
+  for (size_t i = 0; i + 1 < exprs.size(); i++) {
+    const int32_t mark = next_register;
+    emit_into(*exprs[i], allocate());
+    next_register = mark;
+  }
+  if (!exprs.empty())
+    emit_into(*exprs.back(), dst);
+}
+
+void Emitter::visit(const Let &let) {
+  // The registers of the variables are released with the
+  // temporaries of the enclosing expression.
+  const int32_t dst = destination;
+  for (auto decl : let.get_decls())
+    decl->accept(*this);
+  emit_into(let.get_sequence(), dst);
+}
+
+void Emitter::visit(const Identifier &id) {
+  const VarDecl &decl = id.get_decl().get();
+  const int32_t levels = id.get_depth() - decl.get_depth();
+  if (levels)
+    emit({op_LOAD, destination, levels, registers[&decl]});
+  else if (registers[&decl] != destination)
+    emit({op_MOVE, destination, registers[&decl]});
+}
+
+void Emitter::visit(const IfThenElse &ite) {
+  const int32_t dst = destination;
+  std::vector<size_t> is_false;
+  emit_branch_if_false(ite.get_condition(), is_false);
+  emit_into(ite.get_then_part(), dst);
+  const size_t end = emit({op_JUMP, 0});
+  patch(is_false, code().size());
+  emit_into(ite.get_else_part(), dst);
+  patch({end}, code().size());
+}
+
+void Emitter::visit(const VarDecl &decl) {
+  const int32_t reg = allocate();
+  registers[&decl] = reg;
+  emit_into(*decl.get_expr(), reg);
+}
+
+void Emitter::visit(const FunDecl &decl) { function_index(decl); }
+
+void Emitter::visit(const FunCall &call) {
+  const FunDecl &decl = call.get_decl().get();
+  const int32_t dst = destination;
+  const int32_t mark = next_register;
+  const std::vector<Expr *> &args = call.get_args();
+  const int32_t first = allocate(args.size());
+  for (size_t i = 0; i < args.size(); i++)
+    emit_into(*args[i], first + i);
+
+  if (decl.get_expr()) {
+    emit({op_CALL, dst, function_index(decl),
+          call.get_depth() - decl.get_depth(), first});
+  } else {
+    const std::string &name = decl.get_external_name().get();
+    const int p = runtime::find_primitive(name);
+    if (p < 0)
+      utils::error(call.loc, "unknown primitive " + name);
+    emit({op_PRIM, dst, p, first});
+  }
+  next_register = mark;
+}
+
+void Emitter::visit(const WhileLoop &loop) {
+  const int32_t mark = next_register;
+  const size_t test = code().size();
+  loop_exits.emplace_back();
+  emit_branch_if_false(loop.get_condition(), loop_exits.back());
+  emit_into(loop.get_body(), allocate());
+  emit({op_JUMP, int32_t(test)});
+  patch(loop_exits.back(), code().size());
+  loop_exits.pop_back();
+  next_register = mark;
+}
+
+void Emitter::visit(const ForLoop &loop) {
+  const VarDecl &variable = loop.get_variable();
+  const int32_t mark = next_register;
+  const int32_t index = allocate();
+  registers[&variable] = index;
+  emit_into(*variable.get_expr(), index);
+  const int32_t high = allocate();
+  emit_into(loop.get_high(), high);
+
+  // FOR_LOOP stops on equality before incrementing, so that a loop
+  // running up to the largest integer does not overflow.
+  loop_exits.emplace_back();
+  loop_exits.back().push_back(emit({op_JGT, index, high, 0}));
+  const size_t body = code().size();
+  emit_into(loop.get_body(), allocate());
+  emit({op_FOR_LOOP, index, high, int32_t(body)});
+  patch(loop_exits.back(), code().size());
+  loop_exits.pop_back();
+  next_register = mark;
+}
+
+void Emitter::visit(const Break &) {
+  loop_exits.back().push_back(emit({op_JUMP, 0}));
+}
+
+void Emitter::visit(const Assign &assign) {
+  const VarDecl &decl = assign.get_lhs().get_decl().get();
+  const int32_t levels = assign.get_lhs().get_depth() - decl.get_depth();
+  if (!levels) {
+    emit_into(assign.get_rhs(), registers[&decl]);
+    return;
+  }
+  const int32_t mark = next_register;
+  emit({op_STORE, levels, registers[&decl], operand(assign.get_rhs())});
+  next_register = mark;
+}
+
+} // namespace bytecode
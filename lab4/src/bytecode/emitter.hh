@@ -0,0 +1,93 @@
+#ifndef EMITTER_HH
+#define EMITTER_HH
+
+#include <deque>
+#include <initializer_list>
+#include <unordered_map>
+#include <vector>
+
+#include "bytecode.hh"
+#include "../ast/nodes.hh"
+
+namespace bytecode {
+using namespace ast::types;
+
+// Translate a typed program into bytecode. Every expression is
+// emitted into a destination register; variables live in the
+// registers of the frame of their function, and temporaries are
+// allocated above them in stack order.
+class Emitter : public ConstASTVisitor {
+  Program program;
+
+  // Index of the function being emitted.
+  int32_t current = 0;
+
+  std::unordered_map<const FunDecl *, int32_t> functions;
+  std::unordered_map<const VarDecl *, int32_t> registers;
+  std::unordered_map<std::string, int32_t> strings;
+
+  // Functions whose body has not been emitted yet.
+  std::deque<const FunDecl *> pending;
+
+  // First free register in the current frame.
+  int32_t next_register = 0;
+
+  // Register receiving the value of the visited expression.
+  int32_t destination = 0;
+
+  // Jumps to patch with the exit of every enclosing loop.
+  std::vector<std::vector<size_t>> loop_exits;
+
+  std::vector<int32_t> &code() { return program.functions[current].code; }
+
+  // Append an instruction and return the position of its last
+  // operand, which is the target of jumps.
+  size_t emit(std::initializer_list<int32_t> words);
+
+  // Point the jumps at the given positions to target.
+  void patch(const std::vector<size_t> &jumps, size_t target);
+
+  // Reserve count consecutive registers and return the first one.
+  int32_t allocate(int32_t count = 1);
+
+  // Emit an expression into a given register.
+  void emit_into(const Expr &expr, int32_t dst);
+
+  // Return a register holding the value of an expression, which
+  // is the register of a local variable or a new temporary.
+  int32_t operand(const Expr &expr);
+
+  // Emit the operands of a comparison, and return their registers.
+  void comparison_operands(const BinaryOperator &op, int32_t &a, int32_t &b);
+
+  // Emit jumps, added to jumps, taken if a condition is false.
+  void emit_branch_if_false(const Expr &condition, std::vector<size_t> &jumps);
+
+  // Return the index of a function, scheduling its body.
+  int32_t function_index(const FunDecl &decl);
+
+  void emit_function(const FunDecl &decl);
+
+public:
+  // Emit the program whose main function declaration is given.
+  Program emit_program(const FunDecl &main);
+
+  virtual void visit(const IntegerLiteral &);
+  virtual void visit(const StringLiteral &);
+  virtual void visit(const BinaryOperator &);
+  virtual void visit(const Sequence &);
+  virtual void visit(const Let &);
+  virtual void visit(const Identifier &);
+  virtual void visit(const IfThenElse &);
+  virtual void visit(const VarDecl &);
+  virtual void visit(const FunDecl &);
+  virtual void visit(const FunCall &);
+  virtual void visit(const WhileLoop &);
+  virtual void visit(const ForLoop &);
+  virtual void visit(const Break &);
+  virtual void visit(const Assign &);
+};
+
+} // namespace bytecode
+
+#endif // EMITTER_HH
@@ -0,0 +1,287 @@
+#include <algorithm>
+
+#include "bytecode.hh"
+#include "../runtime/memory.hh"
+#include "../runtime/runtime.hh"
+#include "../utils/errors.hh"
+
+// Dispatch through a table of label addresses when the compiler
+// supports it, so that every handler jumps directly to the next
+// one. Other compilers get a switch in a loop.
+#if defined(__GNUC__)
+#define BYTECODE_THREADED 1
+#endif
+
+namespace bytecode {
+
+namespace {
+
+union Value {
+  int32_t i;
+  const char *s;
+};
+
+struct Frame {
+  const Function *function;
+  Value *registers;
+  // Index of the frame of the enclosing function.
+  size_t static_link;
+  // Where to go back, and where to store the result.
+  const int32_t *return_pc;
+  int32_t return_register;
+};
+
+// Report an error detected while running the program.
+[[noreturn]] void runtime_error(const std::string &message) {
+  __flush();
+  utils::error(message);
+}
+
+Value call_primitive(int32_t primitive, const Value *args) {
+  Value v;
+  v.i = 0;
+  using namespace runtime;
+  switch (primitive) {
+  case p_print_err: __print_err(args[0].s); break;
+  case p_print: __print(args[0].s); break;
+  case p_print_int: __print_int(args[0].i); break;
+  case p_flush: __flush(); break;
+  case p_getchar: v.s = __getchar(); break;
+  case p_ord: v.i = __ord(args[0].s); break;
+  case p_chr: v.s = __chr(args[0].i); break;
+  case p_size: v.i = __size(args[0].s); break;
+  case p_substring: v.s = __substring(args[0].s, args[1].i, args[2].i); break;
+  case p_concat: v.s = __concat(args[0].s, args[1].s); break;
+  case p_strcmp: v.i = __strcmp(args[0].s, args[1].s); break;
+  case p_streq: v.i = __streq(args[0].s, args[1].s); break;
+  case p_not: v.i = __not(args[0].i); break;
+  case p_exit: __exit(args[0].i);
+  default: runtime_error("invalid primitive in bytecode");
+  }
+  return v;
+}
+
+// Registers available to a program, and initially allocated.
+const size_t max_stack = 1 << 20;
+const size_t initial_stack = 1 << 12;
+
+} // namespace
+
+int run(const Program &program) {
+  std::vector<const char *> strings(program.strings.size());
+  runtime::Roots string_roots(strings.data(),
+                              strings.data() + strings.size());
+  for (size_t k = 0; k < strings.size(); k++)
+    strings[k] = runtime::make_string(program.strings[k].data(),
+                                      program.strings[k].size());
+
+  // The stack grows on demand, and strings held in the registers of
+  // the active frames must survive collections.
+  std::vector<Value> stack(initial_stack);
+  Value *stack_end = stack.data() + stack.size();
+  const void *live_begin = stack.data();
+  const void *live_end = live_begin;
+  runtime::Roots roots(&live_begin, &live_end);
+  std::vector<Frame> frames;
+
+  const Function *function = &program.functions.front();
+  Value *r = stack.data();
+
+  // Make room for count registers from registers on, moving the
+  // frames to a larger stack, and return where registers moved.
+  auto reserve = [&](Value *registers, size_t count) -> Value * {
+    const size_t used = registers - stack.data();
+    if (count > max_stack - used)
+      runtime_error("stack overflow");
+    std::vector<Value> grown(std::min(max_stack, 2 * (used + count)));
+    std::copy(stack.data(), registers, grown.data());
+    for (auto &f : frames)
+      f.registers = grown.data() + (f.registers - stack.data());
+    stack.swap(grown);
+    stack_end = stack.data() + stack.size();
+    live_begin = stack.data();
+    return stack.data() + used;
+  };
+
+  if (function->registers > stack_end - r)
+    r = reserve(r, function->registers);
+  live_end = r + function->registers;
+  frames.push_back({function, r, 0, nullptr, 0});
+  const int32_t *code = function->code.data();
+  const int32_t *pc = code;
+
+  // Registers of the frame levels static links above the current one.
+  auto up = [&frames](int32_t levels) -> size_t {
+    size_t f = frames.size() - 1;
+    for (int32_t i = 0; i < levels; i++)
+      f = frames[f].static_link;
+    return f;
+  };
+
+#define ARITHMETIC(op, expr)                                                  \
+  CASE(op) {                                                                  \
+    const uint32_t a = r[pc[2]].i, b = r[pc[3]].i;                            \
+    r[pc[1]].i = (expr);                                                      \
+    pc += 4;                                                                  \
+    DISPATCH();                                                               \
+  }
+#define COMPARE(op, cmp)                                                      \
+  CASE(op) {                                                                  \
+    r[pc[1]].i = r[pc[2]].i cmp r[pc[3]].i;                                   \
+    pc += 4;                                                                  \
+    DISPATCH();                                                               \
+  }
+#define JUMP_COMPARE(op, cmp)                                                 \
+  CASE(op) {                                                                  \
+    pc = r[pc[1]].i cmp r[pc[2]].i ? code + pc[3] : pc + 4;                   \
+    DISPATCH();                                                               \
+  }
+
+#ifdef BYTECODE_THREADED
+// Label addresses and computed gotos are GNU extensions.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define BYTECODE_LABEL(name) &&do_##name,
+  static const void *const labels[] = {BYTECODE_OPCODES(BYTECODE_LABEL)};
+#undef BYTECODE_LABEL
+#define CASE(name) do_##name:
+#define DISPATCH() goto *labels[*pc]
+  DISPATCH();
+#else
+#define CASE(name) case op_##name:
+#define DISPATCH() continue
+  for (;;)
+    switch (*pc) {
+#endif
+
+  CASE(CONST) {
+    r[pc[1]].i = pc[2];
+    pc += 3;
+    DISPATCH();
+  }
+  CASE(STRING) {
+    r[pc[1]].s = strings[pc[2]];
+    pc += 3;
+    DISPATCH();
+  }
+  CASE(MOVE) {
+    r[pc[1]] = r[pc[2]];
+    pc += 3;
+    DISPATCH();
+  }
+  CASE(LOAD) {
+    r[pc[1]] = frames[up(pc[2])].registers[pc[3]];
+    pc += 4;
+    DISPATCH();
+  }
+  CASE(STORE) {
+    frames[up(pc[1])].registers[pc[2]] = r[pc[3]];
+    pc += 4;
+    DISPATCH();
+  }
+
+  // Arithmetic wraps around like in the generated code.
+  ARITHMETIC(ADD, a + b)
+  ARITHMETIC(SUB, a - b)
+  ARITHMETIC(MUL, a * b)
+  CASE(DIV) {
+    const int32_t a = r[pc[2]].i, b = r[pc[3]].i;
+    if (b == 0)
+      runtime_error("division by zero");
+    r[pc[1]].i = b == -1 ? 0U - uint32_t(a) : uint32_t(a / b);
+    pc += 4;
+    DISPATCH();
+  }
+
+  COMPARE(EQ, ==)
+  COMPARE(NE, !=)
+  COMPARE(LT, <)
+  COMPARE(LE, <=)
+  COMPARE(GT, >)
+  COMPARE(GE, >=)
+
+  CASE(JUMP) {
+    pc = code + pc[1];
+    DISPATCH();
+  }
+  CASE(JUMP_IF_FALSE) {
+    pc = r[pc[1]].i ? pc + 3 : code + pc[2];
+    DISPATCH();
+  }
+  CASE(JUMP_IF_TRUE) {
+    pc = r[pc[1]].i ? code + pc[2] : pc + 3;
+    DISPATCH();
+  }
+
+  JUMP_COMPARE(JEQ, ==)
+  JUMP_COMPARE(JNE, !=)
+  JUMP_COMPARE(JLT, <)
+  JUMP_COMPARE(JLE, <=)
+  JUMP_COMPARE(JGT, >)
+  JUMP_COMPARE(JGE, >=)
+
+  CASE(FOR_LOOP) {
+    Value &index = r[pc[1]];
+    if (index.i != r[pc[2]].i) {
+      index.i++;
+      pc = code + pc[3];
+    } else {
+      pc += 4;
+    }
+    DISPATCH();
+  }
+
+  CASE(CALL) {
+    const Function *const callee = &program.functions[pc[2]];
+    Value *callee_registers = r + function->registers;
+    if (callee->registers > stack_end - callee_registers) {
+      callee_registers = reserve(callee_registers, callee->registers);
+      r = frames.back().registers;
+    }
+    live_end = callee_registers + callee->registers;
+    for (int32_t i = 0; i < callee->params; i++)
+      callee_registers[i] = r[pc[4] + i];
+    frames.push_back({callee, callee_registers, up(pc[3]), pc + 5, pc[1]});
+    function = callee;
+    r = callee_registers;
+    code = pc = callee->code.data();
+    DISPATCH();
+  }
+  CASE(PRIM) {
+    r[pc[1]] = call_primitive(pc[2], r + pc[3]);
+    pc += 4;
+    DISPATCH();
+  }
+  CASE(RETURN) {
+    const Value value = r[pc[1]];
+    const Frame done = frames.back();
+    frames.pop_back();
+    if (frames.empty()) {
+      __flush();
+      return value.i;
+    }
+    function = frames.back().function;
+    r = frames.back().registers;
+    live_end = r + function->registers;
+    code = function->code.data();
+    pc = done.return_pc;
+    r[done.return_register] = value;
+    DISPATCH();
+  }
+
+#ifdef BYTECODE_THREADED
+#pragma GCC diagnostic pop
+#else
+    default:
+      runtime_error("invalid opcode in bytecode");
+    }
+#endif
+
+#undef CASE
+#undef DISPATCH
+#undef ARITHMETIC
+#undef COMPARE
+#undef JUMP_COMPARE
+}
+
+} // namespace bytecode
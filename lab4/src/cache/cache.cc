@@ -0,0 +1,157 @@
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "cache.hh"
+#include "../runtime/runtime.hh"
+#include "../utils/errors.hh"
+#include "../utils/hash.hh"
+
+namespace cache {
+
+namespace {
+
+bool read_file(const std::string &filename, std::string &contents) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in)
+    return false;
+  contents.assign(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+  return true;
+}
+
+// Write a file atomically, so that concurrent compilations never
+// see it partially written.
+void write_file(const std::string &filename, const std::string &contents,
+                mode_t mode) {
+  const std::string tmp = filename + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream out(tmp, std::ios::binary);
+    out.write(contents.data(), contents.size());
+    if (!out)
+      utils::error("cannot write " + tmp);
+  }
+  chmod(tmp.c_str(), mode);
+  if (rename(tmp.c_str(), filename.c_str()))
+    utils::error("cannot store " + filename);
+}
+
+struct Stats {
+  unsigned long hits = 0;
+  unsigned long misses = 0;
+  double saved_seconds = 0;
+};
+
+Stats parse_stats(const std::string &contents) {
+  Stats stats;
+  std::istringstream in(contents);
+  in >> stats.hits >> stats.misses >> stats.saved_seconds;
+  return stats;
+}
+
+} // namespace
+
+Cache::Cache(const std::string &_dir, const std::string &source,
+             const std::string &options)
+    : dir(_dir) {
+  key = "dtiger " PACKAGE_VERSION "\nllvm " LLVM_VERSION "\nruntime " +
+        std::to_string(runtime::abi_version) + "\n" + options + "\n" + source;
+  utils::Hash hash;
+  hash.add(key);
+  entry = dir + "/" + hash.hex();
+  mkdir(dir.c_str(), 0777);
+}
+
+bool Cache::fetch(const std::string &output) {
+  unlink(output.c_str());
+
+  // The metadata is stored last, so the entry is complete if it
+  // can be read.
+  std::string meta;
+  if (!read_file(entry + ".meta", meta)) {
+    record(false, 0);
+    return false;
+  }
+  const size_t newline = meta.find('\n');
+  if (newline == std::string::npos || meta.compare(newline + 1,
+                                                   std::string::npos, key)) {
+    record(false, 0);
+    return false;
+  }
+
+  const std::string object = entry + ".o";
+  if (link(object.c_str(), output.c_str())) {
+    std::string contents;
+    if (!read_file(object, contents)) {
+      record(false, 0);
+      return false;
+    }
+    std::ofstream out(output, std::ios::binary);
+    out.write(contents.data(), contents.size());
+    if (!out)
+      utils::error("cannot write " + output);
+  }
+  record(true, std::stod(meta.substr(0, newline)));
+  return true;
+}
+
+void Cache::store(const std::string &output, double seconds) {
+  std::string contents;
+  if (!read_file(output, contents))
+    return;
+  // Entries are read-only, so that writing through a hard link to
+  // one of them fails instead of corrupting it.
+  write_file(entry + ".o", contents, 0444);
+  write_file(entry + ".meta", std::to_string(seconds) + "\n" + key, 0444);
+}
+
+void Cache::record(bool hit, double saved_seconds) {
+  const std::string filename = dir + "/stats";
+  const int fd = open(filename.c_str(), O_RDWR | O_CREAT, 0666);
+  if (fd < 0)
+    return;
+  flock(fd, LOCK_EX);
+
+  std::string contents;
+  char buffer[256];
+  ssize_t n;
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+    contents.append(buffer, n);
+  Stats stats = parse_stats(contents);
+  if (hit) {
+    stats.hits++;
+    stats.saved_seconds += saved_seconds;
+  } else {
+    stats.misses++;
+  }
+
+  std::ostringstream out;
+  out << stats.hits << " " << stats.misses << " " << stats.saved_seconds
+      << "\n";
+  const std::string updated = out.str();
+  if (ftruncate(fd, 0) == 0 &&
+      pwrite(fd, updated.data(), updated.size(), 0) < 0)
+    utils::non_fatal_error("cannot update " + filename);
+  close(fd);
+}
+
+void Cache::print_stats(const std::string &dir, std::ostream &out) {
+  std::string contents;
+  read_file(dir + "/stats", contents);
+  const Stats stats = parse_stats(contents);
+  const unsigned long lookups = stats.hits + stats.misses;
+  out << "cache directory: " << dir << "\n"
+      << "hits: " << stats.hits << "\n"
+      << "misses: " << stats.misses << "\n"
+      << "hit rate: "
+      << (lookups ? 100.0 * stats.hits / lookups : 0.0) << "%\n"
+      << "time saved: " << stats.saved_seconds << "s\n";
+}
+
+} // namespace cache
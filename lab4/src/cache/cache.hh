@@ -0,0 +1,43 @@
+#ifndef CACHE_HH
+#define CACHE_HH
+
+#include <ostream>
+#include <string>
+
+namespace cache {
+
+// Cache of object files, keyed on the bytes of the source file, the
+// versions of dtiger and LLVM, and the options the compilation
+// depends on. An entry holds the object file, along with its full
+// key, to rule out hash collisions, and the time it took to build.
+class Cache {
+  const std::string dir;
+  std::string key;
+  // Entry path, without extension.
+  std::string entry;
+
+  // Count a hit or a miss in the statistics of the cache.
+  void record(bool hit, double saved_seconds);
+
+public:
+  // Look up the compilation of source, the bytes read from the
+  // input file or the standard input, with the given options.
+  Cache(const std::string &dir, const std::string &source,
+        const std::string &options);
+
+  // If the compilation is cached, place its object file at output
+  // (as a hard link when possible) and return true. Otherwise,
+  // remove output, which may be a hard link to an entry.
+  bool fetch(const std::string &output);
+
+  // Store the object file produced by the compilation, which took
+  // seconds to build.
+  void store(const std::string &output, double seconds);
+
+  // Print the hit rate and the time saved by the cache in dir.
+  static void print_stats(const std::string &dir, std::ostream &out);
+};
+
+} // namespace cache
+
+#endif // CACHE_HH
@@ -1,18 +1,126 @@
 #include <boost/program_options.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
 
 #include "../ast/ast_dumper.hh"
 #include "../ast/binder.hh"
 #include "../ast/escaper.hh"
 #include "../ast/type_checker.hh"
 #include "../parser/parser_driver.hh"
+#include "../bytecode/bytecode.hh"
+#include "../bytecode/emitter.hh"
+#include "../cache/cache.hh"
+#include "../interp/interpreter.hh"
+#include "../interp/tiered.hh"
 #include "../irgen/irgen.hh"
+#include "../irgen/objects.hh"
 #include "../utils/errors.hh"
+#include "server.hh"
 
-int main(int argc, char **argv) {
+namespace po = boost::program_options;
+
+// Describe the options a compilation depends on, for the cache.
+static std::string option_key(const po::variables_map &vm) {
+  std::string key;
+  for (auto &option : vm) {
+    const std::string &name = option.first;
+    if (name == "input-file" || name == "object" || name == "executable" ||
+        name == "cache-dir" || name == "cache-stats")
+      continue;
+    key += name + "=";
+    const boost::any &value = option.second.value();
+    if (auto s = boost::any_cast<std::string>(&value))
+      key += *s;
+    else if (auto u = boost::any_cast<unsigned>(&value))
+      key += std::to_string(*u);
+    key += ";";
+  }
+  // Object files linked into executables are position independent,
+  // unlike the others, wherever either goes.
+  if (vm.count("executable"))
+    key += "executable;";
+  return key;
+}
+
+// The object file an executable is linked from when -o is not given.
+// It is removed when dtiger exits, even on errors.
+static std::string temporary_object;
+
+static void remove_temporary_object() {
+  unlink(temporary_object.c_str());
+}
+
+static std::string create_temporary_object() {
+  const char *const tmpdir = getenv("TMPDIR");
+  std::string name =
+      std::string(tmpdir ? tmpdir : "/tmp") + "/dtiger-XXXXXX.o";
+  const int fd = mkstemps(&name[0], 2);
+  if (fd < 0) {
+    utils::error("cannot create a temporary object file: " +
+                 std::string(strerror(errno)));
+  }
+  close(fd);
+  temporary_object = name;
+  atexit(remove_temporary_object);
+  return name;
+}
+
+// Link the object file into the requested executable, if any.
+static void link(const po::variables_map &vm, const std::string &object,
+                 const std::string &executable) {
+  if (!vm.count("executable")) {
+    return;
+  }
+  irgen::link_executable(object, executable);
+}
+
+// Read a source file, or the standard input for "-", followed by the
+// two null bytes the lexer needs to scan it in place.
+static std::string read_source(const std::string &file) {
+  std::ostringstream source;
+  if (file == "-") {
+    source << std::cin.rdbuf();
+  } else {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+      utils::error("cannot open " + file + ": " + strerror(errno));
+    }
+    source << in.rdbuf();
+  }
+  return source.str() + std::string(2, '\0');
+}
+
+// A binder with the primitives already entered. The compile server
+// creates it before forking, so that every request starts from its
+// copy instead of setting up the prelude again.
+static std::unique_ptr<ast::binder::Binder> prepared_binder;
+
+static std::unique_ptr<ast::binder::Binder> take_binder() {
+  if (prepared_binder)
+    return std::move(prepared_binder);
+  return std::unique_ptr<ast::binder::Binder>(new ast::binder::Binder());
+}
+
+static int compile(int argc, char **argv) {
   std::string output_file;
+  std::string executable_file;
+  std::string bytecode_file;
+  std::string function_cache_dir;
+  std::string cache_dir;
+  std::string socket_path;
+  unsigned tier_threshold;
+  unsigned irgen_threads;
+  unsigned codegen_threads;
   std::vector<std::string> input_files;
-  namespace po = boost::program_options;
   po::options_description options("Options");
   options.add_options()
   ("help,h", "describe arguments")
@@ -21,11 +129,33 @@ int main(int argc, char **argv) {
   ("bind,b", "run the binder on the parsed AST")
   ("type,t", "run the type checker on the parsed AST")
   ("irgen,i", "run the LLVM IR code generator")
+  ("run", "JIT-compile the program and run it in-process")
+  ("interpret", "run the program with the AST interpreter")
+  ("tiered", "interpret the program, JIT-compiling its hot functions")
+  ("tier-threshold", po::value(&tier_threshold)->default_value(1000),
+   "calls and loop iterations making a function hot")
+  ("emit-bytecode", po::value(&bytecode_file), "generate bytecode file")
+  ("vm", "run the program in the bytecode virtual machine")
+  ("run-bytecode", "run the bytecode file given as input")
+  ("irgen-threads", po::value(&irgen_threads)->default_value(1),
+   "generate the object file by partitions with this many threads")
+  ("codegen-threads", po::value(&codegen_threads)->default_value(1),
+   "run the backend on module partitions with this many threads")
+  ("function-cache", po::value(&function_cache_dir),
+   "reuse the object code of unchanged functions from this directory")
+  ("cache-dir", po::value(&cache_dir),
+   "reuse object files of identical compilations from this directory")
+  ("cache-stats", "print the hit rate and time saved by the cache")
+  ("serve", po::value(&socket_path),
+   "serve compile requests on this Unix socket (used by dtiger when "
+   "DTIGER_SERVER is set to its path)")
   ("trace-parser", "enable parser traces")
   ("trace-lexer", "enable lexer traces")
   ("verbose,v", "be verbose")
   ("input-file", po::value(&input_files), "input Tiger file")
-  ("object,o", po::value(&output_file), "generate object code file");
+  ("object,o", po::value(&output_file), "generate object code file")
+  ("executable", po::value(&executable_file),
+   "generate an executable linked with the Tiger runtime");
 
   po::positional_options_description positional;
   positional.add("input-file", 1);
@@ -43,38 +173,140 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  if (vm.count("serve")) {
+    irgen::initialize_native_target();
+    prepared_binder = take_binder();
+    return server::serve(socket_path,
+                         std::max(1U, std::thread::hardware_concurrency()),
+                         compile);
+  }
+
+  if (vm.count("cache-stats")) {
+    if (!vm.count("cache-dir")) {
+      utils::error("--cache-stats needs --cache-dir");
+    }
+    cache::Cache::print_stats(cache_dir, std::cout);
+    if (input_files.empty()) {
+      return 0;
+    }
+  }
+
   if (input_files.size() != 1) {
     utils::error("usage: dtiger [options] input-file");
   }
 
+  if (vm.count("run-bytecode")) {
+    return bytecode::run(bytecode::load(input_files[0]));
+  }
+
+  // Executables are linked from an object file, kept only if
+  // requested.
+  const bool object = vm.count("object") || vm.count("executable");
+  if (vm.count("executable") && !vm.count("object")) {
+    output_file = create_temporary_object();
+  }
+
+  // Only compilations producing nothing but an object file are
+  // cached, since hits skip everything else.
+  const bool cacheable =
+      object && vm.count("cache-dir") && !vm.count("dump-ast") &&
+      !vm.count("dump-ir") && !vm.count("run") && !vm.count("interpret") &&
+      !vm.count("tiered") && !vm.count("vm") && !vm.count("emit-bytecode") &&
+      !vm.count("trace-parser") && !vm.count("trace-lexer");
+  // The source is read first, so that the standard input can be
+  // cached too.
+  std::string source = read_source(input_files[0]);
+  std::unique_ptr<cache::Cache> object_cache;
+  if (cacheable) {
+    object_cache.reset(new cache::Cache(cache_dir, source, option_key(vm)));
+    if (object_cache->fetch(output_file)) {
+      link(vm, output_file, executable_file);
+      return 0;
+    }
+  }
+  const auto start = std::chrono::steady_clock::now();
+
   ParserDriver parser_driver = ParserDriver(vm.count("trace-lexer"), vm.count("trace-parser"));
 
-  if (!parser_driver.parse(input_files[0])) {
+  utils::LocationFile location_file(input_files[0]);
+  if (!parser_driver.parse_buffer(&source[0], source.size() - 2,
+                                  input_files[0])) {
     utils::error("parser failed");
   }
 
+  const bool function_cache = object && vm.count("function-cache");
+  // The object code of partitioned programs does not depend on the
+  // number of threads, but differs from that of whole programs.
+  const bool parallel_irgen =
+      object && !vm["irgen-threads"].defaulted() && !function_cache;
+  const bool partitioned = function_cache || parallel_irgen;
+  const bool generate_ir = vm.count("irgen") || vm.count("run") ||
+                           (object && !partitioned);
+  const bool emit_bytecode = vm.count("emit-bytecode") || vm.count("vm");
+  const bool analyze = generate_ir || partitioned || emit_bytecode ||
+                       vm.count("interpret") || vm.count("tiered");
+
   FunDecl *main = nullptr;
-  if (vm.count("bind") || vm.count("type") || vm.count("irgen") || vm.count("object")) {
-    ast::binder::Binder binder;
-    main = binder.analyze_program(*parser_driver.result_ast);
+  if (vm.count("bind") || vm.count("type") || analyze) {
+    const std::unique_ptr<ast::binder::Binder> binder = take_binder();
+    main = binder->analyze_program(*parser_driver.result_ast);
     ast::escaper::Escaper escaper;
     main->accept(escaper);
   }
 
-  if (vm.count("type") || vm.count("irgen") || vm.count("object")) {
+  if (vm.count("type") || analyze) {
     ast::type_checker::TypeChecker type_checker;
     main->accept(type_checker);
   }
 
-  if (vm.count("irgen") || vm.count("object")) {
+  int status = 0;
+  if (vm.count("interpret")) {
+    interp::Interpreter interpreter;
+    status = interpreter.run(*main);
+  }
+  if (vm.count("tiered")) {
+    interp::TieredEngine engine(tier_threshold);
+    status = engine.run(*main);
+  }
+
+  if (emit_bytecode) {
+    bytecode::Emitter emitter;
+    const bytecode::Program program = emitter.emit_program(*main);
+    if (vm.count("emit-bytecode")) {
+      bytecode::save(program, bytecode_file);
+    }
+    if (vm.count("vm")) {
+      status = bytecode::run(program);
+    }
+  }
+
+  if (function_cache) {
+    irgen::write_object_cached(main, function_cache_dir, irgen_threads,
+                               output_file);
+  }
+  if (parallel_irgen) {
+    irgen::write_object_parallel(main, irgen_threads, output_file);
+  }
+
+  if (generate_ir) {
     irgen::IRGenerator ir_generator;
     ir_generator.generate_program(main);
 
     if (vm.count("dump-ir")) {
       ir_generator.print_ir(&std::cout);
     }
-    if (vm.count("object")) {
-      ir_generator.write_object(output_file);
+    if (object && !partitioned) {
+      if (!vm["codegen-threads"].defaulted()) {
+        ir_generator.write_object_split(output_file, codegen_threads);
+      } else if (vm.count("executable")) {
+        // Executables are linked as position independent.
+        ir_generator.emit_object(output_file);
+      } else {
+        ir_generator.write_object(output_file);
+      }
+    }
+    if (vm.count("run")) {
+      status = ir_generator.run_main();
     }
   }
 
@@ -87,5 +319,26 @@ int main(int argc, char **argv) {
     dumper.nl();
   }
   delete parser_driver.result_ast;
-  return 0;
+
+  if (object_cache) {
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    object_cache->store(output_file, elapsed.count());
+  }
+  link(vm, output_file, executable_file);
+  return status;
+}
+
+int main(int argc, char **argv) {
+  // Let a compile server do the work if there is one, unless this
+  // is the server itself.
+  const char *const server = getenv("DTIGER_SERVER");
+  bool serving = false;
+  for (int i = 1; i < argc; i++)
+    serving = serving || !strncmp(argv[i], "--serve", 7);
+  int status;
+  if (server && !serving && server::forward(server, argc, argv, status)) {
+    return status;
+  }
+  return compile(argc, argv);
 }
@@ -0,0 +1,244 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "server.hh"
+#include "../utils/errors.hh"
+
+// A request is a 4-byte length followed by the working directory and
+// the arguments of the client, each terminated by a null byte. The
+// standard input, output and error of the client are passed along
+// with the length. The answer is a single byte, the exit status.
+
+namespace server {
+
+namespace {
+
+bool send_all(int fd, const char *data, size_t size) {
+  while (size) {
+    const ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool recv_all(int fd, char *data, size_t size) {
+  while (size) {
+    const ssize_t n = recv(fd, data, size, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool make_address(const std::string &socket_path, sockaddr_un &address) {
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path))
+    return false;
+  strcpy(address.sun_path, socket_path.c_str());
+  return true;
+}
+
+// Receive the length of a request and the standard streams of the
+// client.
+bool receive_header(int client, uint32_t &length, int fds[3]) {
+  char control[CMSG_SPACE(3 * sizeof(int))];
+  iovec iov = {&length, sizeof(length)};
+  msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  const ssize_t n = recvmsg(client, &message, 0);
+  if (n <= 0)
+    return false;
+  cmsghdr *const cmsg = CMSG_FIRSTHDR(&message);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+    return false;
+  memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+  return recv_all(client, reinterpret_cast<char *>(&length) + n,
+                  sizeof(length) - n);
+}
+
+// Run a request in a new process, and send its exit status back.
+void handle(int client, Compile compile) {
+  uint32_t length;
+  int fds[3];
+  if (!receive_header(client, length, fds))
+    return;
+  std::vector<char> payload(length);
+  if (!recv_all(client, payload.data(), length) || !length ||
+      payload.back() != '\0')
+    return;
+
+  // The working directory comes first, then the arguments.
+  std::vector<char *> args;
+  for (size_t i = 0; i < length; i += strlen(&payload[i]) + 1)
+    args.push_back(&payload[i]);
+  const char *const cwd = args.front();
+  args.erase(args.begin());
+  for (auto arg : args)
+    if (!strncmp(arg, "--serve", 7)) {
+      const char code = EXIT_FAILURE;
+      send_all(client, &code, 1);
+      return;
+    }
+  args.push_back(nullptr);
+
+  // Move to the client's directory here rather than in the compiling
+  // process, so that a failure can be reported to the client directly.
+  if (chdir(cwd)) {
+    dprintf(fds[2], "cannot change directory to %s: %s\n", cwd,
+            strerror(errno));
+    for (int fd = 0; fd < 3; fd++)
+      close(fds[fd]);
+    const char code = EXIT_FAILURE;
+    send_all(client, &code, 1);
+    return;
+  }
+
+  const pid_t pid = fork();
+  if (pid == 0) {
+    close(client);
+    for (int fd = 0; fd < 3; fd++) {
+      dup2(fds[fd], fd);
+      close(fds[fd]);
+    }
+    exit(compile(args.size() - 1, args.data()));
+  }
+  for (int fd = 0; fd < 3; fd++)
+    close(fds[fd]);
+
+  int status = 0;
+  char code = EXIT_FAILURE;
+  if (pid > 0 && waitpid(pid, &status, 0) == pid)
+    code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  send_all(client, &code, 1);
+}
+
+} // namespace
+
+int serve(const std::string &socket_path, unsigned workers, Compile compile) {
+  sockaddr_un address;
+  if (!make_address(socket_path, address))
+    utils::error("socket path too long: " + socket_path);
+  const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path.c_str());
+  if (listener < 0 ||
+      bind(listener, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) ||
+      listen(listener, SOMAXCONN))
+    utils::error("cannot listen on " + socket_path + ": " + strerror(errno));
+
+  signal(SIGPIPE, SIG_IGN);
+  unsigned active = 0;
+  for (;;) {
+    // Reap finished requests, waiting for one when all the workers
+    // are busy.
+    while (active) {
+      const pid_t pid = waitpid(-1, nullptr, active < workers ? WNOHANG : 0);
+      if (pid <= 0)
+        break;
+      active--;
+    }
+
+    const int client = accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      utils::error(std::string("cannot accept requests: ") + strerror(errno));
+    }
+    const pid_t pid = fork();
+    if (pid == 0) {
+      close(listener);
+      handle(client, compile);
+      _exit(0);
+    }
+    close(client);
+    if (pid > 0)
+      active++;
+  }
+}
+
+bool forward(const std::string &socket_path, int argc, char **argv,
+             int &status) {
+  sockaddr_un address;
+  if (!make_address(socket_path, address))
+    return false;
+  const int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0)
+    return false;
+  if (connect(server, reinterpret_cast<sockaddr *>(&address),
+              sizeof(address))) {
+    close(server);
+    return false;
+  }
+
+  std::vector<char> payload;
+  char *const cwd = getcwd(nullptr, 0);
+  if (!cwd) {
+    close(server);
+    return false;
+  }
+  payload.insert(payload.end(), cwd, cwd + strlen(cwd) + 1);
+  free(cwd);
+  for (int i = 0; i < argc; i++)
+    payload.insert(payload.end(), argv[i], argv[i] + strlen(argv[i]) + 1);
+
+  uint32_t length = payload.size();
+  const int fds[3] = {0, 1, 2};
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  iovec iov = {&length, sizeof(length)};
+  msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  cmsghdr *const cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  if (sendmsg(server, &message, MSG_NOSIGNAL) != sizeof(length) ||
+      !send_all(server, payload.data(), payload.size())) {
+    close(server);
+    return false;
+  }
+
+  // Once the request is sent, the compilation has started and must
+  // not be run again.
+  char code;
+  if (!recv_all(server, &code, 1)) {
+    utils::non_fatal_error("lost connection to the compile server");
+    code = EXIT_FAILURE;
+  }
+  close(server);
+  status = static_cast<unsigned char>(code);
+  return true;
+}
+
+} // namespace server
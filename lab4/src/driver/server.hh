@@ -0,0 +1,28 @@
+#ifndef SERVER_HH
+#define SERVER_HH
+
+#include <string>
+
+namespace server {
+
+// Entry point of a compilation, with the command line arguments of
+// dtiger, returning the exit status.
+typedef int (*Compile)(int argc, char **argv);
+
+// Serve compile requests on a Unix socket, running up to workers of
+// them at once. Every request runs compile in a process forked from
+// the server, which has already paid for the process startup and
+// the initialization of LLVM. The request runs in the working
+// directory of the client and with its standard streams.
+int serve(const std::string &socket_path, unsigned workers, Compile compile);
+
+// Have the server listening on socket_path run a compilation with
+// the given arguments, and store its exit status. Return false if
+// the server cannot be reached, in which case the compilation must
+// be run directly.
+bool forward(const std::string &socket_path, int argc, char **argv,
+             int &status);
+
+} // namespace server
+
+#endif // SERVER_HH
@@ -0,0 +1,51 @@
+#include <memory>
+#include <sstream>
+
+#include "dtiger.hh"
+#include "../ast/binder.hh"
+#include "../ast/escaper.hh"
+#include "../ast/type_checker.hh"
+#include "../irgen/irgen.hh"
+#include "../parser/parser_driver.hh"
+
+namespace dtiger {
+
+Result compile(std::string source, const Options &options) {
+  Result result;
+  utils::CollectDiagnostics collect(result.diagnostics);
+  utils::LocationFile location_file(options.name);
+  utils::ThrowErrors throw_errors;
+  try {
+    irgen::IRGenerator ir_generator;
+    ParserDriver parser_driver(options.trace_lexer, options.trace_parser);
+    parser_driver.result_ast = nullptr;
+    const size_t size = source.size();
+    source.append(2, '\0');
+    const bool parsed =
+        parser_driver.parse_buffer(&source[0], size, options.name);
+    std::unique_ptr<Expr> ast(parser_driver.result_ast);
+    if (!parsed)
+      utils::error("parser failed");
+
+    ast::binder::Binder binder;
+    FunDecl *const main = binder.analyze_program(*ast);
+    ast::escaper::Escaper escaper;
+    main->accept(escaper);
+    ast::type_checker::TypeChecker type_checker;
+    main->accept(type_checker);
+    ir_generator.generate_program(main);
+
+    if (options.ir) {
+      std::ostringstream ir;
+      ir_generator.print_ir(&ir);
+      result.ir = ir.str();
+    }
+    if (!options.object_file.empty())
+      ir_generator.write_object(options.object_file);
+    result.success = true;
+  } catch (const utils::Error &) {
+  }
+  return result;
+}
+
+} // namespace dtiger
@@ -0,0 +1,46 @@
+#ifndef DTIGER_HH
+#define DTIGER_HH
+
+#include <string>
+
+#include "../utils/errors.hh"
+
+// Library interface to the compiler, for programs compiling Tiger
+// code without running dtiger. Errors are reported in the result
+// rather than on std::cerr, and do not end the process.
+
+namespace dtiger {
+
+struct Options {
+  // Name of the source in diagnostics.
+  std::string name = "<buffer>";
+  bool trace_lexer = false;
+  bool trace_parser = false;
+  // Return the LLVM IR of the program in the result.
+  bool ir = false;
+  // Write the object code of the program into this file if not empty.
+  std::string object_file;
+};
+
+struct Result {
+  bool success = false;
+  // Every error reported by the compilation. A failed compilation
+  // reports at least one.
+  utils::Diagnostics diagnostics;
+  // The LLVM IR of the program, if requested.
+  std::string ir;
+};
+
+// Compile a Tiger program. The source is scanned in place, so moving
+// it in avoids any copy. The lexer and the symbol table are shared by
+// the whole process, so compilations must not run concurrently.
+// Errors are located in the source of the failing compilation, even
+// though the lexer never resets its position (see
+// utils::set_location_origin). The prebuilt parser and binder are
+// built without exceptions, so a failed compilation leaks the part of
+// the AST built so far and the binder's scopes.
+Result compile(std::string source, const Options &options = Options());
+
+} // namespace dtiger
+
+#endif // DTIGER_HH
@@ -0,0 +1,435 @@
+#include "interpreter.hh"
+#include "../runtime/memory.hh"
+#include "../utils/errors.hh"
+
+namespace interp {
+
+namespace {
+
+// Report an error detected while running the program.
+[[noreturn]] void runtime_error(const std::string &message) {
+  __flush();
+  utils::error(message);
+}
+
+Value integer(int32_t i) {
+  Value v;
+  v.i = i;
+  return v;
+}
+
+// Apply an operator to integers (or to the result of comparing
+// strings, and 0). Arithmetic wraps around like in the generated
+// code.
+int32_t apply(Operator op, int32_t left, int32_t right) {
+  const uint32_t ul = left, ur = right;
+  switch (op) {
+  case o_plus: return ul + ur;
+  case o_minus: return ul - ur;
+  case o_times: return ul * ur;
+  case o_divide:
+    if (right == 0)
+      runtime_error("division by zero");
+    return right == -1 ? 0U - ul : uint32_t(left / right);
+  case o_eq: return left == right;
+  case o_neq: return left != right;
+  case o_lt: return left < right;
+  case o_le: return left <= right;
+  case o_gt: return left > right;
+  case o_ge: return left >= right;
+  }
+  return 0;
+}
+
+// Assign a slot in the frame of its function to every variable
+// declaration, record which primitive every external function
+// without a body stands for, and count string literals.
+class FrameLayout : public ConstASTVisitor {
+  std::unordered_map<const VarDecl *, unsigned> &slots;
+  std::unordered_map<const FunDecl *, Function> &functions;
+  std::unordered_map<const FunDecl *, runtime::primitive> &primitives;
+  size_t &strings;
+  unsigned next_slot = 0;
+
+public:
+  FrameLayout(std::unordered_map<const VarDecl *, unsigned> &_slots,
+              std::unordered_map<const FunDecl *, Function> &_functions,
+              std::unordered_map<const FunDecl *, runtime::primitive> &_primitives,
+              size_t &_strings)
+      : slots(_slots), functions(_functions), primitives(_primitives),
+        strings(_strings) {}
+
+  virtual void visit(const IntegerLiteral &) {}
+  virtual void visit(const StringLiteral &) { strings++; }
+  virtual void visit(const BinaryOperator &op) {
+    op.get_left().accept(*this);
+    op.get_right().accept(*this);
+  }
+  virtual void visit(const Sequence &seq) {
+    for (auto expr : seq.get_exprs())
+      expr->accept(*this);
+  }
+  virtual void visit(const Let &let) {
+    for (auto decl : let.get_decls())
+      decl->accept(*this);
+    let.get_sequence().accept(*this);
+  }
+  virtual void visit(const Identifier &) {}
+  virtual void visit(const IfThenElse &ite) {
+    ite.get_condition().accept(*this);
+    ite.get_then_part().accept(*this);
+    ite.get_else_part().accept(*this);
+  }
+  virtual void visit(const VarDecl &decl) {
+    slots[&decl] = next_slot++;
+    if (decl.get_expr())
+      decl.get_expr()->accept(*this);
+  }
+  virtual void visit(const FunDecl &decl) {
+    // Every function has its own frame, starting with its parameters.
+    if (!decl.get_expr())
+      return;
+    FrameLayout inner(slots, functions, primitives, strings);
+    for (auto param : decl.get_params())
+      param->accept(inner);
+    decl.get_expr()->accept(inner);
+    Function &function = functions[&decl];
+    function.decl = &decl;
+    function.frame_size = inner.next_slot;
+  }
+  virtual void visit(const FunCall &call) {
+    const FunDecl &decl = call.get_decl().get();
+    if (!decl.get_expr()) {
+      const std::string &name = decl.get_external_name().get();
+      const int p = runtime::find_primitive(name);
+      if (p < 0)
+        utils::error(call.loc, "unknown primitive " + name);
+      primitives[&decl] = runtime::primitive(p);
+    }
+    for (auto arg : call.get_args())
+      arg->accept(*this);
+  }
+  virtual void visit(const WhileLoop &loop) {
+    loop.get_condition().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const ForLoop &loop) {
+    loop.get_variable().accept(*this);
+    loop.get_high().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const Break &) {}
+  virtual void visit(const Assign &assign) {
+    assign.get_lhs().accept(*this);
+    assign.get_rhs().accept(*this);
+  }
+};
+
+} // namespace
+
+Interpreter::Interpreter() : stack(1 << 20) {}
+
+int Interpreter::run(const FunDecl &main) {
+  size_t strings = 0;
+  FrameLayout layout(slots, functions, primitives, strings);
+  main.accept(layout);
+
+  // Strings held in frame slots or used as literals must survive
+  // collections.
+  runtime::Roots roots(stack.data(), stack.data() + stack.size());
+  literals.resize(strings);
+  runtime::Roots literal_roots(literals.data(),
+                               literals.data() + literals.size());
+
+  // Compile main, and with it every function, once and for all.
+  main.accept(*this);
+
+  Function &function = functions.find(&main)->second;
+  const Value result =
+      call(function, nullptr, push_slots(function.frame_size));
+  __flush();
+  return result.i;
+}
+
+void Interpreter::set_hot_handler(
+    unsigned threshold, std::function<void(const FunDecl &)> handler) {
+  hot_threshold = threshold;
+  on_hot = handler;
+}
+
+void Interpreter::install(const FunDecl &decl, Native native) {
+  // The table is complete before the program starts, and the
+  // compiled code refers to its entries directly, so looking it up
+  // concurrently with the interpreter is safe.
+  functions.find(&decl)->second.native.store(native,
+                                             std::memory_order_release);
+}
+
+Frame *Interpreter::frame_up(int levels) {
+  Frame *f = frame;
+  for (int i = 0; i < levels; i++)
+    f = f->static_link;
+  return f;
+}
+
+Access Interpreter::resolve(const Identifier &id) {
+  const VarDecl &decl = id.get_decl().get();
+  return {id.get_depth() - decl.get_depth(), slots[&decl]};
+}
+
+Code Interpreter::compile(const Expr &expr) {
+  expr.accept(*this);
+  return code;
+}
+
+Value *Interpreter::push_slots(unsigned count) {
+  if (count > stack.size() - stack_top)
+    runtime_error("stack overflow");
+  Value *const slots = stack.data() + stack_top;
+  stack_top += count;
+  return slots;
+}
+
+Value Interpreter::call(Function &function, Frame *static_link,
+                        Value *slots) {
+  Frame callee = {static_link, slots};
+  Frame *const caller = frame;
+  Function *const caller_function = current;
+  frame = &callee;
+  current = &function;
+  const Value result = function.body();
+  frame = caller;
+  current = caller_function;
+  stack_top = slots - stack.data();
+  return result;
+}
+
+Value Interpreter::call_primitive(runtime::primitive primitive,
+                                  const Value *args) {
+  Value v;
+  v.i = 0;
+  using namespace runtime;
+  switch (primitive) {
+  case p_print_err: __print_err(args[0].s); break;
+  case p_print: __print(args[0].s); break;
+  case p_print_int: __print_int(args[0].i); break;
+  case p_flush: __flush(); break;
+  case p_getchar: v.s = __getchar(); break;
+  case p_ord: v.i = __ord(args[0].s); break;
+  case p_chr: v.s = __chr(args[0].i); break;
+  case p_size: v.i = __size(args[0].s); break;
+  case p_substring: v.s = __substring(args[0].s, args[1].i, args[2].i); break;
+  case p_concat: v.s = __concat(args[0].s, args[1].s); break;
+  case p_strcmp: v.i = __strcmp(args[0].s, args[1].s); break;
+  case p_streq: v.i = __streq(args[0].s, args[1].s); break;
+  case p_not: v.i = __not(args[0].i); break;
+  case p_exit: __exit(args[0].i);
+  }
+  return v;
+}
+
+void Interpreter::visit(const IntegerLiteral &literal) {
+  const Value value = integer(literal.value);
+  code = [value] { return value; };
+}
+
+void Interpreter::visit(const StringLiteral &literal) {
+  const std::string &value = literal.value.get();
+  Value &string = literals[next_literal++];
+  string.s = runtime::make_string(value.data(), value.size());
+  const Value result = string;
+  code = [result] { return result; };
+}
+
+void Interpreter::visit(const BinaryOperator &op) {
+  const Code left = compile(op.get_left());
+  const Code right = compile(op.get_right());
+  const Operator o = op.op;
+
+  if (op.get_left().get_type() == t_string) {
+    code = [left, right, o] {
+      const Value l = left();
+      const Value r = right();
+      return integer(apply(o, __strcmp(l.s, r.s), 0));
+    };
+    return;
+  }
+  code = [left, right, o] {
+    const int32_t l = left().i;
+    const int32_t r = right().i;
+    return integer(apply(o, l, r));
+  };
+}
+
+void Interpreter::visit(const Sequence &seq) {
+  std::vector<Code> exprs;
+  for (auto expr : seq.get_exprs())
+    exprs.push_back(compile(*expr));
+  code = [this, exprs] {
+    Value value = integer(0);
+    for (auto &expr : exprs) {
+      value = expr();
+      if (breaking)
+        break;
+    }
+    return value;
+  };
+}
+
+void Interpreter::visit(const Let &let) {
+  std::vector<Code> decls;
+  for (auto decl : let.get_decls()) {
+    decl->accept(*this);
+    if (code)
+      decls.push_back(code);
+  }
+  const Code sequence = compile(let.get_sequence());
+  code = [this, decls, sequence] {
+    for (auto &decl : decls) {
+      decl();
+      if (breaking)
+        return integer(0);
+    }
+    return sequence();
+  };
+}
+
+void Interpreter::visit(const Identifier &id) {
+  const Access access = resolve(id);
+  const unsigned slot = access.slot;
+  if (access.levels == 0) {
+    code = [this, slot] { return frame->slots[slot]; };
+    return;
+  }
+  const int levels = access.levels;
+  code = [this, levels, slot] { return frame_up(levels)->slots[slot]; };
+}
+
+void Interpreter::visit(const IfThenElse &ite) {
+  const Code condition = compile(ite.get_condition());
+  const Code then_part = compile(ite.get_then_part());
+  const Code else_part = compile(ite.get_else_part());
+  code = [this, condition, then_part, else_part] {
+    const int32_t c = condition().i;
+    if (breaking)
+      return integer(0);
+    return c ? then_part() : else_part();
+  };
+}
+
+void Interpreter::visit(const VarDecl &decl) {
+  const unsigned slot = slots[&decl];
+  const Code expr = compile(*decl.get_expr());
+  code = [this, slot, expr] {
+    const Value value = expr();
+    frame->slots[slot] = value;
+    return value;
+  };
+}
+
+void Interpreter::visit(const FunDecl &decl) {
+  // The body is compiled with the function, and the declaration
+  // itself does nothing at run time.
+  if (decl.get_expr())
+    functions.find(&decl)->second.body = compile(*decl.get_expr());
+  code = nullptr;
+}
+
+void Interpreter::visit(const FunCall &call) {
+  const FunDecl &decl = call.get_decl().get();
+  std::vector<Code> args;
+  for (auto arg : call.get_args())
+    args.push_back(compile(*arg));
+
+  if (!decl.get_expr()) {
+    const runtime::primitive primitive = primitives[&decl];
+    code = [this, primitive, args] {
+      Value values[3];
+      for (unsigned i = 0; i < args.size(); i++)
+        values[i] = args[i]();
+      return call_primitive(primitive, values);
+    };
+    return;
+  }
+
+  // Arguments are evaluated directly into the parameter slots of
+  // the new frame. Calls made meanwhile push their frames above it.
+  Function *const function = &functions.find(&decl)->second;
+  const int levels = call.get_depth() - decl.get_depth();
+  code = [this, function, levels, args] {
+    Value *const slots = push_slots(function->frame_size);
+    for (unsigned i = 0; i < args.size(); i++)
+      slots[i] = args[i]();
+
+    if (Native native = function->native.load(std::memory_order_acquire)) {
+      Value result = integer(0);
+      native(slots, &result);
+      stack_top = slots - stack.data();
+      return result;
+    }
+
+    tick(*function);
+    return this->call(*function, frame_up(levels), slots);
+  };
+}
+
+void Interpreter::visit(const WhileLoop &loop) {
+  const Code condition = compile(loop.get_condition());
+  const Code body = compile(loop.get_body());
+  code = [this, condition, body] {
+    while (condition().i && !breaking) {
+      body();
+      if (breaking)
+        break;
+      tick(*current);
+    }
+    breaking = false;
+    return integer(0);
+  };
+}
+
+void Interpreter::visit(const ForLoop &loop) {
+  const VarDecl &variable = loop.get_variable();
+  const unsigned slot = slots[&variable];
+  const Code low = compile(*variable.get_expr());
+  const Code high = compile(loop.get_high());
+  const Code body = compile(loop.get_body());
+  code = [this, slot, low, high, body] {
+    const int32_t l = low().i;
+    const int32_t h = high().i;
+    Value &index = frame->slots[slot];
+
+    // Stop on equality before incrementing, so that a loop running
+    // up to the largest integer does not overflow.
+    for (int32_t i = l; l <= h; i++) {
+      index.i = i;
+      body();
+      if (breaking || i == h)
+        break;
+      tick(*current);
+    }
+    breaking = false;
+    return integer(0);
+  };
+}
+
+void Interpreter::visit(const Break &) {
+  code = [this] {
+    breaking = true;
+    return integer(0);
+  };
+}
+
+void Interpreter::visit(const Assign &assign) {
+  const Access access = resolve(assign.get_lhs());
+  const int levels = access.levels;
+  const unsigned slot = access.slot;
+  const Code rhs = compile(assign.get_rhs());
+  code = [this, levels, slot, rhs] {
+    const Value value = rhs();
+    frame_up(levels)->slots[slot] = value;
+    return integer(0);
+  };
+}
+
+} // namespace interp
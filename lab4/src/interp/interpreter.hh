@@ -0,0 +1,154 @@
+#ifndef INTERPRETER_HH
+#define INTERPRETER_HH
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "../ast/nodes.hh"
+#include "../runtime/runtime.hh"
+
+namespace interp {
+using namespace ast::types;
+
+// A Tiger value. The type checker guarantees which member is
+// meaningful. Strings use the runtime representation, so that
+// primitives can be called directly.
+union Value {
+  int32_t i;
+  const char *s;
+};
+
+// Activation record of a Tiger function. Slots hold the function
+// parameters first, then every variable declared in its body.
+struct Frame {
+  Frame *static_link;
+  Value *slots;
+};
+
+// Location of a variable, relative to the frame of the function
+// in which it is used.
+struct Access {
+  int levels;
+  unsigned slot;
+};
+
+// An expression compiled into a tree of closures, which evaluates
+// it in the current frame and returns its value.
+typedef std::function<Value()> Code;
+
+// Native code for a function, called with its arguments in
+// consecutive slots, and storing its result (if any) in result.
+typedef void (*Native)(Value *args, Value *result);
+
+// What the interpreter knows about a Tiger function with a body.
+struct Function {
+  const FunDecl *decl = nullptr;
+  unsigned frame_size = 0;
+  Code body;
+  // Number of calls and loop iterations run in the interpreter.
+  unsigned counter = 0;
+  // Installed once the function has been compiled, possibly
+  // from another thread.
+  std::atomic<Native> native{nullptr};
+};
+
+class Interpreter : public ConstASTVisitor {
+  // Current function frame.
+  Frame *frame = nullptr;
+
+  // Storage for the frame slots of all active functions.
+  std::vector<Value> stack;
+  size_t stack_top = 0;
+
+  // Function whose body is being evaluated.
+  Function *current = nullptr;
+
+  // Set by break until the enclosing loop has been left.
+  bool breaking = false;
+
+  // Frame layout, computed once before running the program and
+  // only used to compile it: the compiled code refers to slots,
+  // functions and primitives directly.
+  std::unordered_map<const VarDecl *, unsigned> slots;
+  std::unordered_map<const FunDecl *, Function> functions;
+  std::unordered_map<const FunDecl *, runtime::primitive> primitives;
+
+  // Runtime representation of the string literals, in the order in
+  // which they are compiled.
+  std::vector<Value> literals;
+  size_t next_literal = 0;
+
+  // Code of the last compiled node (empty for function declarations).
+  Code code;
+
+  // Function reported to on_hot once its counter reaches
+  // hot_threshold, if set.
+  unsigned hot_threshold = 0;
+  std::function<void(const FunDecl &)> on_hot;
+
+  // Count a call or a loop iteration in a function.
+  void tick(Function &function) {
+    if (++function.counter == hot_threshold && on_hot)
+      on_hot(*function.decl);
+  }
+
+  // Return the frame 0 or more levels above the current one
+  // (0 corresponds to the current frame).
+  Frame *frame_up(int levels);
+
+  // Return the location of a variable used by an identifier.
+  Access resolve(const Identifier &id);
+
+  // Compile an expression.
+  Code compile(const Expr &expr);
+
+  // Reserve the slots of a new frame on the stack.
+  Value *push_slots(unsigned count);
+
+  // Run the body of a Tiger function whose frame slots have been
+  // reserved and filled with the arguments, and release them.
+  Value call(Function &function, Frame *static_link, Value *slots);
+
+  // Run a primitive with evaluated arguments.
+  Value call_primitive(runtime::primitive primitive, const Value *args);
+
+public:
+  Interpreter();
+
+  // Run the program whose main function declaration is given,
+  // and return the status returned by main.
+  int run(const FunDecl &main);
+
+  // Report functions whose number of calls and loop iterations
+  // reaches threshold to handler, once each. The handler may
+  // install native code for them at any later time.
+  void set_hot_handler(unsigned threshold,
+                       std::function<void(const FunDecl &)> handler);
+
+  // Run native code instead of interpreting a function from its
+  // next call on. This may be called from any thread.
+  void install(const FunDecl &decl, Native native);
+
+  // Compile a node, leaving its code in code.
+  virtual void visit(const IntegerLiteral &);
+  virtual void visit(const StringLiteral &);
+  virtual void visit(const BinaryOperator &);
+  virtual void visit(const Sequence &);
+  virtual void visit(const Let &);
+  virtual void visit(const Identifier &);
+  virtual void visit(const IfThenElse &);
+  virtual void visit(const VarDecl &);
+  virtual void visit(const FunDecl &);
+  virtual void visit(const FunCall &);
+  virtual void visit(const WhileLoop &);
+  virtual void visit(const ForLoop &);
+  virtual void visit(const Break &);
+  virtual void visit(const Assign &);
+};
+
+} // namespace interp
+
+#endif // INTERPRETER_HH
@@ -0,0 +1,222 @@
+#include <algorithm>
+
+#include "tiered.hh"
+#include "../irgen/irgen.hh"
+
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+
+namespace interp {
+
+namespace {
+
+// Record, for every function with a body, the variables and the
+// functions it uses directly (not from its inner functions), and
+// the function declaring every variable.
+class FunctionUses : public ConstASTVisitor {
+  const FunDecl *current = nullptr;
+
+public:
+  std::vector<const FunDecl *> functions;
+  std::unordered_map<const VarDecl *, const FunDecl *> owner;
+  std::unordered_map<const FunDecl *, std::vector<const VarDecl *>> variables;
+  std::unordered_map<const FunDecl *, std::vector<const FunDecl *>> callees;
+
+  virtual void visit(const IntegerLiteral &) {}
+  virtual void visit(const StringLiteral &) {}
+  virtual void visit(const BinaryOperator &op) {
+    op.get_left().accept(*this);
+    op.get_right().accept(*this);
+  }
+  virtual void visit(const Sequence &seq) {
+    for (auto expr : seq.get_exprs())
+      expr->accept(*this);
+  }
+  virtual void visit(const Let &let) {
+    for (auto decl : let.get_decls())
+      decl->accept(*this);
+    let.get_sequence().accept(*this);
+  }
+  virtual void visit(const Identifier &id) {
+    variables[current].push_back(&id.get_decl().get());
+  }
+  virtual void visit(const IfThenElse &ite) {
+    ite.get_condition().accept(*this);
+    ite.get_then_part().accept(*this);
+    ite.get_else_part().accept(*this);
+  }
+  virtual void visit(const VarDecl &decl) {
+    owner[&decl] = current;
+    if (decl.get_expr())
+      decl.get_expr()->accept(*this);
+  }
+  virtual void visit(const FunDecl &decl) {
+    if (!decl.get_expr())
+      return;
+    const FunDecl *const enclosing = current;
+    current = &decl;
+    functions.push_back(&decl);
+    for (auto param : decl.get_params())
+      param->accept(*this);
+    decl.get_expr()->accept(*this);
+    current = enclosing;
+  }
+  virtual void visit(const FunCall &call) {
+    const FunDecl &decl = call.get_decl().get();
+    if (decl.get_expr())
+      callees[current].push_back(&decl);
+    for (auto arg : call.get_args())
+      arg->accept(*this);
+  }
+  virtual void visit(const WhileLoop &loop) {
+    loop.get_condition().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const ForLoop &loop) {
+    loop.get_variable().accept(*this);
+    loop.get_high().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const Break &) {}
+  virtual void visit(const Assign &assign) {
+    assign.get_lhs().accept(*this);
+    assign.get_rhs().accept(*this);
+  }
+};
+
+// Return true if inner is outer or is declared inside it.
+bool is_inside(const FunDecl *inner, const FunDecl *outer) {
+  for (const FunDecl *f = inner; f;
+       f = f->get_parent() ? &f->get_parent().get() : nullptr)
+    if (f == outer)
+      return true;
+  return false;
+}
+
+} // namespace
+
+TieredEngine::TieredEngine(unsigned threshold) {
+  interpreter.set_hot_handler(
+      threshold, [this](const FunDecl &decl) { on_hot(decl); });
+}
+
+TieredEngine::~TieredEngine() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake_compiler.notify_one();
+  if (compiler.joinable())
+    compiler.join();
+}
+
+int TieredEngine::run(FunDecl &_main) {
+  main = &_main;
+  find_closed_functions();
+  const int status = interpreter.run(*main);
+  // Functions still waiting will never run again.
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake_compiler.notify_one();
+  if (compiler.joinable())
+    compiler.join();
+  return status;
+}
+
+void TieredEngine::find_closed_functions() {
+  FunctionUses uses;
+  main->accept(uses);
+
+  // Start with the functions whose body, including inner functions,
+  // only uses their own variables. Main never gets called again.
+  for (auto f : uses.functions) {
+    if (f == main)
+      continue;
+    bool is_closed = true;
+    for (auto g : uses.functions)
+      if (is_inside(g, f))
+        for (auto v : uses.variables[g])
+          is_closed = is_closed && is_inside(uses.owner[v], f);
+    if (is_closed)
+      closed.insert(f);
+  }
+
+  // Then drop those which call a function declared outside of them
+  // which is not closed, or not declared next to them: reaching its
+  // static link would go through the null one, until nothing
+  // changes.
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto f = closed.begin(); f != closed.end();) {
+      const FunDecl *const parent = &(*f)->get_parent().get();
+      bool calls_open = false;
+      for (auto g : uses.functions)
+        if (is_inside(g, *f))
+          for (auto callee : uses.callees[g])
+            calls_open = calls_open ||
+                         (!is_inside(callee, *f) &&
+                          (!closed.count(callee) ||
+                           &callee->get_parent().get() != parent));
+      if (calls_open) {
+        f = closed.erase(f);
+        changed = true;
+      } else {
+        f++;
+      }
+    }
+  }
+
+  // Gather the functions declared next to every closed function
+  // that it calls, directly or not.
+  for (auto f : closed) {
+    std::vector<const FunDecl *> &unit = units[f];
+    unit.push_back(f);
+    for (size_t i = 0; i < unit.size(); i++)
+      for (auto g : uses.functions)
+        if (is_inside(g, unit[i]))
+          for (auto callee : uses.callees[g])
+            if (!is_inside(callee, unit[i]) &&
+                std::find(unit.begin(), unit.end(), callee) == unit.end())
+              unit.push_back(callee);
+  }
+}
+
+void TieredEngine::on_hot(const FunDecl &decl) {
+  if (!closed.count(&decl))
+    return;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    hot.push_back(&decl);
+  }
+  if (!compiler.joinable())
+    compiler = std::thread(&TieredEngine::compile, this);
+  wake_compiler.notify_one();
+}
+
+void TieredEngine::compile() {
+  std::unique_lock<std::mutex> guard(lock);
+  for (;;) {
+    wake_compiler.wait(guard, [this] { return stopping || !hot.empty(); });
+    if (stopping)
+      return;
+    const FunDecl *const decl = hot.front();
+    hot.pop_front();
+    // The AST is only read here and by the interpreter.
+    guard.unlock();
+    interpreter.install(*decl, compile_unit(*decl));
+    guard.lock();
+  }
+}
+
+Native TieredEngine::compile_unit(const FunDecl &decl) {
+  irgen::IRGenerator *const generator = new irgen::IRGenerator();
+  generators.emplace_back(generator);
+  generator->generate_functions(units[&decl]);
+  const std::string entry_point = generator->generate_entry_point(decl);
+  engines.push_back(generator->create_jit());
+  return reinterpret_cast<Native>(
+      engines.back()->getFunctionAddress(entry_point));
+}
+
+} // namespace interp
@@ -0,0 +1,93 @@
+#ifndef TIERED_HH
+#define TIERED_HH
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "interpreter.hh"
+
+namespace llvm {
+class ExecutionEngine;
+} // namespace llvm
+
+namespace irgen {
+class IRGenerator;
+} // namespace irgen
+
+namespace interp {
+
+// Run a program in the interpreter, and switch its hot functions
+// to native code as soon as it is available. Native code is
+// generated in the background by the JIT, one hot function at a
+// time.
+//
+// Only closed functions (see below) are compiled, and only take
+// effect from their next call on: there is no on-stack replacement.
+// A hot loop in main, or in a function using variables of its
+// enclosing functions, therefore runs in the interpreter until it
+// ends, however long it runs.
+class TieredEngine {
+  Interpreter interpreter;
+  FunDecl *main = nullptr;
+
+  // Functions which can run natively with a null static link,
+  // because neither they nor the functions they call use the
+  // variables of their enclosing functions, and they only call
+  // functions declared next to them outside of themselves.
+  std::unordered_set<const FunDecl *> closed;
+
+  // For every closed function, itself followed by the functions
+  // declared next to it that it calls, directly or not, which are
+  // compiled along with it.
+  std::unordered_map<const FunDecl *, std::vector<const FunDecl *>> units;
+
+  // Protects the fields below, shared with the compiler thread.
+  std::mutex lock;
+  std::condition_variable wake_compiler;
+
+  // Hot functions waiting for native code, oldest first.
+  std::deque<const FunDecl *> hot;
+
+  // Set when the program is over, so that the compiler thread
+  // stops.
+  bool stopping = false;
+
+  std::thread compiler;
+
+  // Every compiled unit lives in its own generator, whose context
+  // its engine uses, and is only released with the tiered engine.
+  std::vector<std::unique_ptr<irgen::IRGenerator>> generators;
+  std::vector<std::unique_ptr<llvm::ExecutionEngine>> engines;
+
+  // Fill the closed set and the units.
+  void find_closed_functions();
+
+  // Called by the interpreter when a function becomes hot.
+  void on_hot(const FunDecl &decl);
+
+  // Body of the compiler thread, compiling the unit of every hot
+  // function in turn.
+  void compile();
+
+  // Compile the unit of a closed function, and return an entry
+  // point to it callable from the interpreter.
+  Native compile_unit(const FunDecl &decl);
+
+public:
+  explicit TieredEngine(unsigned threshold);
+  ~TieredEngine();
+
+  // Run the program whose main function declaration is given,
+  // and return the status returned by main.
+  int run(FunDecl &main);
+};
+
+} // namespace interp
+
+#endif // TIERED_HH
@@ -0,0 +1,281 @@
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "config.h"
+#include "irgen.hh"
+#include "objects.hh"
+#include "../runtime/runtime.hh"
+#include "../utils/errors.hh"
+#include "../utils/hash.hh"
+
+namespace irgen {
+
+namespace {
+
+// Full key of a cache entry, which is stored along with its object
+// code to rule out hash collisions, like the keys of cache::Cache.
+// Entries are named after its hash.
+class Key {
+  std::string bytes;
+
+public:
+  void add(int64_t v) {
+    bytes.append(reinterpret_cast<const char *>(&v), sizeof(v));
+  }
+  void add(const std::string &s) {
+    add(int64_t(s.size()));
+    bytes += s;
+  }
+  void add(const Key &other) { add(other.bytes); }
+  const std::string &str() const { return bytes; }
+
+  std::string hex() const {
+    utils::Hash hash;
+    hash.add(bytes);
+    return hash.hex();
+  }
+};
+
+// Compute a structural key of every function declared in main,
+// inner functions included, and of the rest of main. Calls include
+// the signature of their callee, so that every key covers the
+// declarations its code depends on. The context covers the rest of
+// what the code of every unit depends on outside of it: the layout
+// of the frame of main.
+class UnitKeys : public ConstASTVisitor {
+  typedef enum {
+    k_integer,
+    k_string,
+    k_binary,
+    k_sequence,
+    k_let,
+    k_identifier,
+    k_if,
+    k_var,
+    k_fun,
+    k_call,
+    k_while,
+    k_for,
+    k_break,
+    k_assign
+  } Kind;
+
+  const FunDecl *main;
+  Key *current;
+
+  void node(Kind kind, const Expr &expr) {
+    current->add(kind);
+    current->add(expr.get_type());
+  }
+
+  static void signature(Key &key, const FunDecl &decl) {
+    key.add(decl.get_external_name().get());
+    key.add(decl.get_type());
+    key.add(decl.is_external);
+    key.add(decl.get_depth());
+    for (auto param : decl.get_params())
+      key.add(param->get_type());
+  }
+
+public:
+  std::vector<const FunDecl *> units;
+  std::unordered_map<const FunDecl *, Key> bodies;
+  Key main_body;
+  Key context;
+
+  explicit UnitKeys(const FunDecl *_main)
+      : main(_main), current(&main_body) {
+    context.add(std::string(PACKAGE_VERSION));
+    context.add(std::string(LLVM_VERSION));
+    context.add(runtime::abi_version);
+  }
+
+  virtual void visit(const IntegerLiteral &literal) {
+    node(k_integer, literal);
+    current->add(literal.value);
+  }
+  virtual void visit(const StringLiteral &literal) {
+    node(k_string, literal);
+    current->add(literal.value.get());
+  }
+  virtual void visit(const BinaryOperator &op) {
+    node(k_binary, op);
+    current->add(op.op);
+    op.get_left().accept(*this);
+    op.get_right().accept(*this);
+  }
+  virtual void visit(const Sequence &seq) {
+    node(k_sequence, seq);
+    current->add(seq.get_exprs().size());
+    for (auto expr : seq.get_exprs())
+      expr->accept(*this);
+  }
+  virtual void visit(const Let &let) {
+    node(k_let, let);
+    current->add(let.get_decls().size());
+    for (auto decl : let.get_decls())
+      decl->accept(*this);
+    let.get_sequence().accept(*this);
+  }
+  virtual void visit(const Identifier &id) {
+    const VarDecl &decl = id.get_decl().get();
+    node(k_identifier, id);
+    current->add(id.get_depth() - decl.get_depth());
+    current->add(decl.name.get());
+    current->add(decl.get_escapes());
+  }
+  virtual void visit(const IfThenElse &ite) {
+    node(k_if, ite);
+    ite.get_condition().accept(*this);
+    ite.get_then_part().accept(*this);
+    ite.get_else_part().accept(*this);
+  }
+  virtual void visit(const VarDecl &decl) {
+    current->add(k_var);
+    current->add(decl.name.get());
+    current->add(decl.get_type());
+    current->add(decl.get_escapes());
+    // Escaping variables of main are laid out in its frame, which
+    // the functions declared in main reach through their static link.
+    if (current == &main_body && decl.get_escapes()) {
+      context.add(decl.name.get());
+      context.add(decl.get_type());
+    }
+    if (decl.get_expr())
+      decl.get_expr()->accept(*this);
+  }
+  virtual void visit(const FunDecl &decl) {
+    if (!decl.get_expr())
+      return;
+    Key *const enclosing = current;
+    if (&decl.get_parent().get() == main) {
+      units.push_back(&decl);
+      current = &bodies[&decl];
+    }
+    current->add(k_fun);
+    signature(*current, decl);
+    for (auto param : decl.get_params())
+      param->accept(*this);
+    decl.get_expr()->accept(*this);
+    current = enclosing;
+  }
+  virtual void visit(const FunCall &call) {
+    const FunDecl &decl = call.get_decl().get();
+    node(k_call, call);
+    signature(*current, decl);
+    current->add(call.get_depth() - decl.get_depth());
+    for (auto arg : call.get_args())
+      arg->accept(*this);
+  }
+  virtual void visit(const WhileLoop &loop) {
+    node(k_while, loop);
+    loop.get_condition().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const ForLoop &loop) {
+    node(k_for, loop);
+    loop.get_variable().accept(*this);
+    loop.get_high().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const Break &brk) { node(k_break, brk); }
+  virtual void visit(const Assign &assign) {
+    node(k_assign, assign);
+    assign.get_lhs().accept(*this);
+    assign.get_rhs().accept(*this);
+  }
+};
+
+bool read_file(const std::string &filename, std::string &contents) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in)
+    return false;
+  contents.assign(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+  return true;
+}
+
+// Return true if an entry, without extension, holds the object code
+// for a key. The key is stored last, so the entry is complete if it
+// matches.
+bool cached(const std::string &entry, const Key &key) {
+  std::string stored;
+  return read_file(entry + ".meta", stored) && stored == key.str() &&
+         access((entry + ".o").c_str(), R_OK) == 0;
+}
+
+// Generate the object code of a partition into an entry, without
+// extension, along with its key. Concurrent compilations may fill
+// the same entry, so every file only appears once complete.
+void store(FunDecl *main, const std::string &entry, const Key &key,
+           const std::vector<const FunDecl *> &declared,
+           const std::unordered_set<const FunDecl *> &units,
+           bool with_main) {
+  const std::string suffix = ".tmp" + std::to_string(getpid());
+  const std::string object = entry + ".o";
+  IRGenerator generator;
+  generator.generate_partition(main, declared, units, with_main);
+  generator.emit_object(object + suffix);
+  if (rename((object + suffix).c_str(), object.c_str()))
+    utils::error("cannot store " + object);
+
+  const std::string meta = entry + ".meta";
+  {
+    std::ofstream out(meta + suffix, std::ios::binary);
+    out.write(key.str().data(), key.str().size());
+    if (!out)
+      utils::error("cannot write " + meta + suffix);
+  }
+  if (rename((meta + suffix).c_str(), meta.c_str()))
+    utils::error("cannot store " + meta);
+}
+
+} // namespace
+
+void write_object_cached(FunDecl *main, const std::string &cache_dir,
+                         unsigned threads, const std::string &filename) {
+  UnitKeys keys(main);
+  main->get_expr()->accept(keys);
+  mkdir(cache_dir.c_str(), 0777);
+
+  // Main comes first, then every unit on its own.
+  std::vector<Key> partition_keys(1);
+  partition_keys[0].add(keys.context);
+  partition_keys[0].add(keys.main_body);
+  for (auto unit : keys.units) {
+    partition_keys.emplace_back();
+    partition_keys.back().add(keys.context);
+    partition_keys.back().add(keys.bodies[unit]);
+  }
+
+  std::vector<std::string> entries;
+  std::vector<size_t> misses;
+  for (size_t k = 0; k < partition_keys.size(); k++) {
+    entries.push_back(cache_dir + "/" + partition_keys[k].hex());
+    if (!cached(entries[k], partition_keys[k]))
+      misses.push_back(k);
+  }
+
+  // Missing partitions are generated concurrently, each by its own
+  // generator. None of them generates the body of main but the first.
+  initialize_native_target();
+  run_jobs(misses.size(), threads, [&](size_t m) {
+    const size_t k = misses[m];
+    if (k == 0)
+      store(main, entries[k], partition_keys[k], keys.units, {}, true);
+    else
+      store(main, entries[k], partition_keys[k], keys.units,
+            {keys.units[k - 1]}, false);
+  });
+
+  std::vector<std::string> objects;
+  for (auto &entry : entries)
+    objects.push_back(entry + ".o");
+  merge_objects(objects, filename);
+}
+
+} // namespace irgen
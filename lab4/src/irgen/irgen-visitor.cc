@@ -1,6 +1,8 @@
+#include <cstdint>
 #include <cstdlib>  // For exit
 #include <iostream> // For std::cerr
 #include "irgen.hh"
+#include "../utils/hash.hh"
 
 #include "llvm/Support/raw_ostream.h"
 
@@ -11,31 +13,337 @@
 
 namespace irgen {
 
+namespace {
+
+// Largest number of nodes in a while condition generated twice to
+// rotate the loop.
+const int max_duplicated_nodes = 16;
+
+// Return true if the code for expr can be generated more than once
+// in the same function, and takes at most budget nodes, which is
+// decreased by the number of nodes seen. Declarations (and thus Let)
+// cannot, as they would be entered twice, and neither can loops,
+// which own their exit block.
+bool can_duplicate(const Expr &expr, int &budget) {
+  if (--budget < 0)
+    return false;
+  if (dynamic_cast<const IntegerLiteral *>(&expr) ||
+      dynamic_cast<const StringLiteral *>(&expr) ||
+      dynamic_cast<const Identifier *>(&expr))
+    return true;
+  if (auto op = dynamic_cast<const BinaryOperator *>(&expr))
+    return can_duplicate(op->get_left(), budget) &&
+           can_duplicate(op->get_right(), budget);
+  if (auto ite = dynamic_cast<const IfThenElse *>(&expr))
+    return can_duplicate(ite->get_condition(), budget) &&
+           can_duplicate(ite->get_then_part(), budget) &&
+           can_duplicate(ite->get_else_part(), budget);
+  if (auto assign = dynamic_cast<const Assign *>(&expr))
+    return can_duplicate(assign->get_rhs(), budget);
+  const std::vector<Expr *> *children = nullptr;
+  if (auto call = dynamic_cast<const FunCall *>(&expr))
+    children = &call->get_args();
+  else if (auto seq = dynamic_cast<const Sequence *>(&expr))
+    children = &seq->get_exprs();
+  if (!children)
+    return false;
+  for (auto child : *children)
+    if (!can_duplicate(*child, budget))
+      return false;
+  return true;
+}
+
+// Return true if expr is the integer literal value.
+bool is_integer(const Expr &expr, int value) {
+  const IntegerLiteral *const literal =
+      dynamic_cast<const IntegerLiteral *>(&expr);
+  return literal && literal->value == value;
+}
+
+// The parser turns a & b into if a then (if b then 1 else 0) else 0
+// and a | b into if a then 1 else (if b then 1 else 0). If ite is one
+// of those, set is_and and return b, otherwise return nullptr.
+const Expr *logical_right(const IfThenElse &ite, bool &is_and) {
+  const Expr *inner;
+  if (is_integer(ite.get_else_part(), 0)) {
+    is_and = true;
+    inner = &ite.get_then_part();
+  } else if (is_integer(ite.get_then_part(), 1)) {
+    is_and = false;
+    inner = &ite.get_else_part();
+  } else {
+    return nullptr;
+  }
+  const IfThenElse *const test = dynamic_cast<const IfThenElse *>(inner);
+  if (!test || !is_integer(test->get_then_part(), 1) ||
+      !is_integer(test->get_else_part(), 0))
+    return nullptr;
+  return &test->get_condition();
+}
+
+// Return expr as a call to the primitive with the given external
+// name, or nullptr if it is not.
+const FunCall *primitive_call(const Expr &expr, const std::string &name) {
+  const FunCall *const call = dynamic_cast<const FunCall *>(&expr);
+  if (!call)
+    return nullptr;
+  const FunDecl &decl = call->get_decl().get();
+  if (decl.get_expr() || decl.get_external_name().get() != name)
+    return nullptr;
+  return call;
+}
+
+// A value known at compile time.
+struct Folded {
+  bool is_string;
+  int32_t i;
+  std::string s;
+};
+
+bool fold(const Expr &expr, Folded &value);
+
+// Expressions known not to fold, while the outermost FoldScope of the
+// thread exists. Generating the code of an expression that does not
+// fold tries to fold its operands again, which would otherwise take
+// time quadratic in the depth of the expression.
+thread_local std::unordered_set<const Expr *> *unfoldable = nullptr;
+
+// Remember the expressions that do not fold until the outermost
+// scope is left. Scopes last while the code of an expression, and
+// thus of its operands, is generated.
+class FoldScope {
+  std::unordered_set<const Expr *> expressions;
+  const bool outermost;
+
+public:
+  FoldScope() : outermost(!unfoldable) {
+    if (outermost)
+      unfoldable = &expressions;
+  }
+  ~FoldScope() {
+    if (outermost)
+      unfoldable = nullptr;
+  }
+  FoldScope(const FoldScope &) = delete;
+  FoldScope &operator=(const FoldScope &) = delete;
+};
+
+bool fold_int(const Expr &expr, int32_t &i) {
+  Folded value;
+  if (!fold(expr, value))
+    return false;
+  i = value.i;
+  return true;
+}
+
+bool fold_string(const Expr &expr, std::string &s) {
+  Folded value;
+  if (!fold(expr, value))
+    return false;
+  s = std::move(value.s);
+  return true;
+}
+
+bool fold_operator(const BinaryOperator &op, Folded &value) {
+  value.is_string = false;
+  int compared;
+  if (op.get_left().get_type() == t_string) {
+    std::string l, r;
+    if (!fold_string(op.get_left(), l) || !fold_string(op.get_right(), r))
+      return false;
+    // Bytes compare as unsigned characters, like in the runtime.
+    compared = l.compare(r);
+  } else {
+    int32_t l, r;
+    if (!fold_int(op.get_left(), l) || !fold_int(op.get_right(), r))
+      return false;
+    // Arithmetic wraps around, and failing divisions are left to
+    // run time.
+    switch (op.op) {
+    case o_plus: value.i = int32_t(uint32_t(l) + uint32_t(r)); return true;
+    case o_minus: value.i = int32_t(uint32_t(l) - uint32_t(r)); return true;
+    case o_times: value.i = int32_t(uint32_t(l) * uint32_t(r)); return true;
+    case o_divide:
+      if (!r || (l == INT32_MIN && r == -1))
+        return false;
+      value.i = l / r;
+      return true;
+    default: break;
+    }
+    compared = l < r ? -1 : l > r;
+  }
+  switch (op.op) {
+  case o_eq: value.i = compared == 0; break;
+  case o_neq: value.i = compared != 0; break;
+  case o_lt: value.i = compared < 0; break;
+  case o_le: value.i = compared <= 0; break;
+  case o_gt: value.i = compared > 0; break;
+  case o_ge: value.i = compared >= 0; break;
+  default: return false;
+  }
+  return true;
+}
+
+// Fold a call to one of the pure primitives, with the semantics of
+// the runtime.
+bool fold_call(const FunCall &call, Folded &value) {
+  const FunDecl &decl = call.get_decl().get();
+  if (decl.get_expr())
+    return false;
+  const std::string &name = decl.get_external_name().get();
+  const std::vector<Expr *> &args = call.get_args();
+  value.is_string = false;
+  std::string s;
+  if (name == "__size" && fold_string(*args[0], s)) {
+    value.i = s.size();
+    return true;
+  }
+  if (name == "__ord" && fold_string(*args[0], s)) {
+    value.i = s.empty() ? -1 : static_cast<unsigned char>(s[0]);
+    return true;
+  }
+  if (name == "__not" && fold_int(*args[0], value.i)) {
+    value.i = !value.i;
+    return true;
+  }
+  value.is_string = true;
+  int32_t i;
+  if (name == "__chr" && fold_int(*args[0], i) && i >= 0 && i <= 255) {
+    value.s = std::string(1, char(i));
+    return true;
+  }
+  int32_t first, length;
+  if (name == "__substring" && fold_string(*args[0], s) &&
+      fold_int(*args[1], first) && fold_int(*args[2], length) &&
+      first >= 0 && length >= 0 && first <= int32_t(s.size()) &&
+      length <= int32_t(s.size()) - first) {
+    value.s = s.substr(first, length);
+    return true;
+  }
+  std::string s2;
+  if (name == "__concat" && fold_string(*args[0], s) &&
+      fold_string(*args[1], s2)) {
+    value.s = s + s2;
+    return true;
+  }
+  return false;
+}
+
+bool fold_expression(const Expr &expr, Folded &value) {
+  if (auto literal = dynamic_cast<const IntegerLiteral *>(&expr)) {
+    value.is_string = false;
+    value.i = literal->value;
+    return true;
+  }
+  if (auto literal = dynamic_cast<const StringLiteral *>(&expr)) {
+    value.is_string = true;
+    value.s = literal->value.get();
+    return true;
+  }
+  if (auto op = dynamic_cast<const BinaryOperator *>(&expr))
+    return fold_operator(*op, value);
+  if (auto call = dynamic_cast<const FunCall *>(&expr))
+    return fold_call(*call, value);
+  return false;
+}
+
+// Evaluate expr at compile time if it only applies operators and
+// pure primitives to literals, and would not fail at run time.
+bool fold(const Expr &expr, Folded &value) {
+  if (unfoldable && unfoldable->count(&expr))
+    return false;
+  if (fold_expression(expr, value))
+    return true;
+  if (unfoldable)
+    unfoldable->insert(&expr);
+  return false;
+}
+
+} // namespace
+
 llvm::Value *IRGenerator::visit(const IntegerLiteral &literal) {
   return Builder.getInt32(literal.value);
 }
 
 llvm::Value *IRGenerator::visit(const StringLiteral &literal) {
-  return Builder.CreateGlobalStringPtr(literal.value.get());
+  return string_constant(literal.value.get());
+}
+
+llvm::Constant *IRGenerator::string_constant(const std::string &value) {
+  // Lay the literal out like the flat strings of the runtime: a
+  // header holding the address of the bytes and their length, then
+  // the bytes and a null byte, the string pointing to the bytes.
+  llvm::Constant *const bytes =
+      llvm::ConstantDataArray::getString(Context, value);
+  llvm::StructType *const header_type = string_header_type();
+  llvm::StructType *const type =
+      llvm::StructType::get(Context, {header_type, bytes->getType()});
+  llvm::Constant *const indices[] = {Builder.getInt32(0), Builder.getInt32(1),
+                                     Builder.getInt32(0)};
+
+  // Every distinct literal is emitted once per module, named after
+  // its contents. Constants are uniqued, so a global of that name
+  // holds the same literal if it holds the same bytes.
+  utils::Hash hash;
+  hash.add(value);
+  const std::string base = "str." + hash.hex();
+  std::string name = base;
+  for (int k = 1;; k++) {
+    llvm::GlobalVariable *const pooled = Mod->getNamedGlobal(name);
+    if (!pooled)
+      break;
+    if (pooled->getInitializer()->getOperand(1) == bytes)
+      return llvm::ConstantExpr::getInBoundsGetElementPtr(type, pooled,
+                                                          indices);
+    name = base + "." + std::to_string(k);
+  }
+
+  llvm::GlobalVariable *const global = new llvm::GlobalVariable(
+      *Mod, type, true, llvm::GlobalValue::PrivateLinkage, nullptr, name);
+  llvm::Constant *const string =
+      llvm::ConstantExpr::getInBoundsGetElementPtr(type, global, indices);
+  global->setInitializer(llvm::ConstantStruct::get(
+      type, {llvm::ConstantStruct::get(
+                 header_type, {string, Builder.getInt32(value.size())}),
+             bytes}));
+  // The modules of a partitioned program are linked together, which
+  // keeps a single copy of the literals.
+  if (partitioned()) {
+    global->setLinkage(llvm::GlobalValue::LinkOnceODRLinkage);
+    global->setVisibility(llvm::GlobalValue::HiddenVisibility);
+    global->setComdat(Mod->getOrInsertComdat(global->getName()));
+  }
+  return string;
 }
 
 llvm::Value *IRGenerator::visit(const Break &b) {
-    Builder.CreateBr(loop_exit_bbs[&(b.get_loop())]);
-    //~ llvm::BasicBlock *const break_block =
-    //~ llvm::BasicBlock::Create(Context, "break", current_function);
+  Builder.CreateBr(loop_exit_bbs[&b.get_loop()]);
+  // Whatever follows the break is unreachable, but still needs a
+  // block to be generated into.
+  Builder.SetInsertPoint(
+      llvm::BasicBlock::Create(Context, "after_break", current_function));
   return nullptr;
- 
 }
 
 llvm::Value *IRGenerator::visit(const BinaryOperator &op) {
+  // Integers are folded by LLVM, but comparisons of strings known at
+  // compile time would still call the runtime.
+  FoldScope scope;
+  Folded folded;
+  if (op.get_left().get_type() == t_string && fold(op, folded))
+    return Builder.getInt32(folded.i);
+
   llvm::Value *l = op.get_left().accept(*this);
   llvm::Value *r = op.get_right().accept(*this);
 
   if (op.get_left().get_type() == t_string) {
-    auto const strcmp = Mod->getOrInsertFunction(
-        "__strcmp", Builder.getInt32Ty(), Builder.getInt8PtrTy(),
-        Builder.getInt8PtrTy(), nullptr);
-    l = Builder.CreateCall(strcmp, {l, r});
+    if (op.op == o_eq || op.op == o_neq) {
+      llvm::Value *const equal = generate_string_equality(l, r);
+      return Builder.CreateZExt(
+          op.op == o_eq ? equal : Builder.CreateNot(equal),
+          Builder.getInt32Ty());
+    }
+    l = generate_string_order(l, r);
     r = Builder.getInt32(0);
   }
 
@@ -64,6 +372,112 @@ llvm::Value *IRGenerator::visit(const BinaryOperator &op) {
   return Builder.CreateIntCast(cmp, Builder.getInt32Ty(), true);
 }
 
+llvm::StructType *IRGenerator::string_header_type() {
+  return llvm::StructType::get(Context,
+                               {Builder.getInt8PtrTy(), Builder.getInt32Ty()});
+}
+
+llvm::Value *IRGenerator::generate_string_equality(llvm::Value *l,
+                                                   llvm::Value *r) {
+  llvm::BasicBlock *const length_block =
+      llvm::BasicBlock::Create(Context, "streq_length", current_function);
+  llvm::BasicBlock *const bytes_block =
+      llvm::BasicBlock::Create(Context, "streq_bytes", current_function);
+  llvm::BasicBlock *const end_block =
+      llvm::BasicBlock::Create(Context, "streq_end", current_function);
+
+  // The same string, such as a literal or an interned character.
+  llvm::BasicBlock *const same_block = Builder.GetInsertBlock();
+  Builder.CreateCondBr(Builder.CreateICmpEQ(l, r), end_block, length_block);
+
+  // Strings of different lengths, read from the headers preceding
+  // them.
+  Builder.SetInsertPoint(length_block);
+  llvm::StructType *const header_type = string_header_type();
+  auto length = [&](llvm::Value *s) {
+    llvm::Value *const header = Builder.CreateInBoundsGEP(
+        header_type,
+        Builder.CreateBitCast(s, header_type->getPointerTo()),
+        Builder.getInt32(-1));
+    return Builder.CreateLoad(Builder.CreateStructGEP(header_type, header, 1));
+  };
+  llvm::Value *const length_l = length(l);
+  llvm::Value *const length_r = length(r);
+  Builder.CreateCondBr(Builder.CreateICmpEQ(length_l, length_r), bytes_block,
+                       end_block);
+
+  Builder.SetInsertPoint(bytes_block);
+  auto const streq = Mod->getOrInsertFunction(
+      "__streq", Builder.getInt32Ty(), Builder.getInt8PtrTy(),
+      Builder.getInt8PtrTy(), nullptr);
+  llvm::Value *const bytes_equal =
+      Builder.CreateICmpNE(Builder.CreateCall(streq, {l, r}),
+                           Builder.getInt32(0));
+  Builder.CreateBr(end_block);
+
+  Builder.SetInsertPoint(end_block);
+  llvm::PHINode *const equal = Builder.CreatePHI(Builder.getInt1Ty(), 3);
+  equal->addIncoming(Builder.getTrue(), same_block);
+  equal->addIncoming(Builder.getFalse(), length_block);
+  equal->addIncoming(bytes_equal, bytes_block);
+  return equal;
+}
+
+llvm::Value *IRGenerator::generate_string_order(llvm::Value *l,
+                                                llvm::Value *r) {
+  llvm::BasicBlock *const bytes_block =
+      llvm::BasicBlock::Create(Context, "strcmp_bytes", current_function);
+  llvm::BasicBlock *const end_block =
+      llvm::BasicBlock::Create(Context, "strcmp_end", current_function);
+
+  llvm::BasicBlock *const same_block = Builder.GetInsertBlock();
+  Builder.CreateCondBr(Builder.CreateICmpEQ(l, r), end_block, bytes_block);
+
+  Builder.SetInsertPoint(bytes_block);
+  auto const compare = Mod->getOrInsertFunction(
+      "__strcmp", Builder.getInt32Ty(), Builder.getInt8PtrTy(),
+      Builder.getInt8PtrTy(), nullptr);
+  llvm::Value *const bytes_order = Builder.CreateCall(compare, {l, r});
+  Builder.CreateBr(end_block);
+
+  Builder.SetInsertPoint(end_block);
+  llvm::PHINode *const order = Builder.CreatePHI(Builder.getInt32Ty(), 2);
+  order->addIncoming(Builder.getInt32(0), same_block);
+  order->addIncoming(bytes_order, bytes_block);
+  return order;
+}
+
+llvm::Value *IRGenerator::generate_logical(const Expr &left,
+                                           const Expr &right, bool is_and) {
+  llvm::BasicBlock *const rhs_block = llvm::BasicBlock::Create(
+      Context, is_and ? "and_rhs" : "or_rhs", current_function);
+  llvm::BasicBlock *const end_block = llvm::BasicBlock::Create(
+      Context, is_and ? "and_end" : "or_end", current_function);
+
+  llvm::Value *const l = Builder.CreateIsNotNull(left.accept(*this));
+  // The left operand may itself have created blocks, so the phi
+  // must refer to the block we are branching from.
+  llvm::BasicBlock *const lhs_exit = Builder.GetInsertBlock();
+  if (is_and)
+    Builder.CreateCondBr(l, rhs_block, end_block);
+  else
+    Builder.CreateCondBr(l, end_block, rhs_block);
+
+  Builder.SetInsertPoint(rhs_block);
+  llvm::Value *const r = Builder.CreateIsNotNull(right.accept(*this));
+  llvm::BasicBlock *const rhs_exit = Builder.GetInsertBlock();
+  Builder.CreateBr(end_block);
+
+  Builder.SetInsertPoint(end_block);
+  llvm::PHINode *const result =
+      Builder.CreatePHI(Builder.getInt1Ty(), 2, is_and ? "and" : "or");
+  result->addIncoming(is_and ? Builder.getFalse() : Builder.getTrue(),
+                      lhs_exit);
+  result->addIncoming(r, rhs_exit);
+
+  return Builder.CreateZExt(result, Builder.getInt32Ty());
+}
+
 llvm::Value *IRGenerator::visit(const Sequence &seq) {
   llvm::Value *result = nullptr;
   for (auto expr : seq.get_exprs())
@@ -85,6 +499,10 @@ llvm::Value *IRGenerator::visit(const Identifier &id) {
 }
 
 llvm::Value *IRGenerator::visit(const IfThenElse &ite) {
+  bool is_and;
+  if (const Expr *const right = logical_right(ite, is_and))
+    return generate_logical(ite.get_condition(), *right, is_and);
+
   //~ if(ite.get_condition.get_type().accept(*this)==t_void){}
   bool returnNull= ite.get_type()==t_void;
   llvm::Value *const result =alloca_in_entry(llvm_type(ite.get_type()), "if_result");
@@ -151,18 +569,61 @@ llvm::Value *IRGenerator::visit(const FunDecl &decl) {
   llvm::FunctionType *ft =
       llvm::FunctionType::get(return_type, param_types, false);
 
-  llvm::Function::Create(ft,
-                         decl.is_external ? llvm::Function::ExternalLinkage
-                                          : llvm::Function::InternalLinkage,
-                         decl.get_external_name().get(), Mod.get());
+  llvm::Function *const function = llvm::Function::Create(
+      ft,
+      decl.is_external || partitioned() ? llvm::Function::ExternalLinkage
+                                    : llvm::Function::InternalLinkage,
+      decl.get_external_name().get(), Mod.get());
+  if (!decl.is_external && partitioned())
+    function->setVisibility(llvm::GlobalValue::HiddenVisibility);
 
-  if (decl.get_expr())
+  if (decl.get_expr() && in_partition(decl))
     pending_func_bodies.push_front(&decl);
 
   return nullptr;
 }
 
+llvm::Value *IRGenerator::generate_ord(const FunCall &call) {
+  if (!primitive_call(call, "__ord"))
+    return nullptr;
+  const Expr &arg = *call.get_args()[0];
+
+  if (primitive_call(arg, "__getchar")) {
+    auto const getchar_code = Mod->getOrInsertFunction(
+        "__getchar_code", Builder.getInt32Ty(), nullptr);
+    return Builder.CreateCall(getchar_code, {}, "call");
+  }
+
+  if (const FunCall *const chr = primitive_call(arg, "__chr")) {
+    // Characters out of range are reported by chr, the others are
+    // their own code.
+    llvm::Value *const code = chr->get_args()[0]->accept(*this);
+    llvm::BasicBlock *const invalid_block =
+        llvm::BasicBlock::Create(Context, "chr_invalid", current_function);
+    llvm::BasicBlock *const valid_block =
+        llvm::BasicBlock::Create(Context, "chr_valid", current_function);
+    Builder.CreateCondBr(Builder.CreateICmpUGT(code, Builder.getInt32(255)),
+                         invalid_block, valid_block);
+    Builder.SetInsertPoint(invalid_block);
+    auto const chr_function = Mod->getOrInsertFunction(
+        "__chr", Builder.getInt8PtrTy(), Builder.getInt32Ty(), nullptr);
+    Builder.CreateCall(chr_function, {code});
+    Builder.CreateUnreachable();
+    Builder.SetInsertPoint(valid_block);
+    return code;
+  }
+  return nullptr;
+}
+
 llvm::Value *IRGenerator::visit(const FunCall &call) {
+  FoldScope scope;
+  Folded folded;
+  if (fold(call, folded))
+    return folded.is_string ? string_constant(folded.s)
+                            : Builder.getInt32(folded.i);
+  if (llvm::Value *const code = generate_ord(call))
+    return code;
+
   // Look up the name in the global module table.
   const FunDecl &decl = call.get_decl().get();
   llvm::Function *callee =
@@ -206,45 +667,89 @@ llvm::Value *IRGenerator::visit(const WhileLoop &loop) {
       llvm::BasicBlock::Create(Context, "loop_body", current_function);
   llvm::BasicBlock *const end_block =
       llvm::BasicBlock::Create(Context, "loop_end", current_function);
-llvm::Value *const condition = loop.get_condition().accept(*this);
- loop_exit_bbs[&loop]=end_block;
-  Builder.CreateBr(test_block);
+  loop_exit_bbs[&loop] = end_block;
+
+  // When the condition can be generated twice, rotate the loop:
+  // a guard in front of the loop, and the test at the bottom.
+  // Otherwise, jump to the test first.
+  int budget = max_duplicated_nodes;
+  if (can_duplicate(loop.get_condition(), budget))
+    Builder.CreateCondBr(
+        Builder.CreateIsNotNull(loop.get_condition().accept(*this)),
+        body_block, end_block);
+  else
+    Builder.CreateBr(test_block);
 
-  Builder.SetInsertPoint(test_block);
-  Builder.CreateCondBr(Builder.CreateIsNotNull(condition),body_block,end_block);  
-                       
-                       
-   Builder.SetInsertPoint(body_block);
+  Builder.SetInsertPoint(body_block);
   loop.get_body().accept(*this);
-
   Builder.CreateBr(test_block);
 
+  // The condition is evaluated again on every iteration.
+  Builder.SetInsertPoint(test_block);
+  Builder.CreateCondBr(
+      Builder.CreateIsNotNull(loop.get_condition().accept(*this)),
+      body_block, end_block);
+
   Builder.SetInsertPoint(end_block);
   return nullptr;
+}
 
+llvm::MDNode *IRGenerator::loop_metadata() {
+  // A loop ID is a distinct node whose first operand is itself,
+  // followed by the loop properties: here, a hint asking the
+  // vectorizer to consider the loop. Unrolling is left to the cost
+  // model of the unroller.
+  auto const self = llvm::MDNode::getTemporary(Context, llvm::None);
+  llvm::Metadata *const enable[] = {
+      llvm::MDString::get(Context, "llvm.loop.vectorize.enable"),
+      llvm::ConstantAsMetadata::get(Builder.getTrue())};
+  llvm::Metadata *const properties[] = {self.get(),
+                                        llvm::MDNode::get(Context, enable)};
+  llvm::MDNode *const loop_id = llvm::MDNode::getDistinct(Context, properties);
+  loop_id->replaceOperandWith(0, loop_id);
+  return loop_id;
 }
 
 llvm::Value *IRGenerator::visit(const ForLoop &loop) {
-  llvm::BasicBlock *const test_block =
-      llvm::BasicBlock::Create(Context, "loop_test", current_function);
   llvm::BasicBlock *const body_block =
       llvm::BasicBlock::Create(Context, "loop_body", current_function);
+  llvm::BasicBlock *const latch_block =
+      llvm::BasicBlock::Create(Context, "loop_latch", current_function);
   llvm::BasicBlock *const end_block =
       llvm::BasicBlock::Create(Context, "loop_end", current_function);
-  llvm::Value *const index = loop.get_variable().accept(*this);
+
+  const VarDecl &variable = loop.get_variable();
+  llvm::Value *const low = variable.get_expr()->accept(*this);
+  llvm::Value *const index = generate_vardecl(variable);
   llvm::Value *const high = loop.get_high().accept(*this);
-  loop_exit_bbs[&loop]=end_block;
-  Builder.CreateBr(test_block);
+  loop_exit_bbs[&loop] = end_block;
 
-  Builder.SetInsertPoint(test_block);
-  Builder.CreateCondBr(Builder.CreateICmpSLE(Builder.CreateLoad(index), high),
-                       body_block, end_block);
+  // Guard: the body runs at least once from here on, which lets
+  // the loop be rotated with the test at the bottom.
+  llvm::BasicBlock *const preheader = Builder.GetInsertBlock();
+  Builder.CreateCondBr(Builder.CreateICmpSLE(low, high), body_block,
+                       end_block);
 
+  // The induction variable lives in a phi. The loop variable is
+  // read-only in Tiger, so the body only ever reads the copy stored
+  // in its slot, which mem2reg removes when it does not escape.
   Builder.SetInsertPoint(body_block);
+  llvm::PHINode *const iv = Builder.CreatePHI(Builder.getInt32Ty(), 2, "index");
+  iv->addIncoming(low, preheader);
+  Builder.CreateStore(iv, index);
   loop.get_body().accept(*this);
-  Builder.CreateStore(
-      Builder.CreateAdd(Builder.CreateLoad(index), Builder.getInt32(1)), index);
-  Builder.CreateBr(test_block);
+  Builder.CreateBr(latch_block);
+
+  // Test for equality with high before incrementing, so that a loop
+  // running up to the largest integer stops instead of overflowing.
+  // The trip count is then simply high - low + 1.
+  Builder.SetInsertPoint(latch_block);
+  llvm::Value *const done = Builder.CreateICmpEQ(iv, high);
+  llvm::Value *const next =
+      Builder.CreateNSWAdd(iv, Builder.getInt32(1), "index_next");
+  iv->addIncoming(next, latch_block);
+  Builder.CreateCondBr(done, end_block, body_block)
+      ->setMetadata(llvm::LLVMContext::MD_loop, loop_metadata());
 
   Builder.SetInsertPoint(end_block);
   return nullptr;
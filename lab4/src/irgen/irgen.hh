@@ -3,11 +3,16 @@
 
 #include "../ast/nodes.hh"
 #include <ostream>
+#include <unordered_set>
 
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 
+namespace llvm {
+class ExecutionEngine;
+} // namespace llvm
+
 namespace irgen {
 using namespace ast::types;
 
@@ -54,6 +59,15 @@ class IRGenerator : public ConstASTValueVisitor {
   // Frame of the current function.
   llvm::Value *frame;
 
+  // Return true while generate_partition runs, in which case only
+  // some function bodies are generated.
+  bool partitioned() const;
+
+  // Return true if the body of a function belongs to the partition
+  // being generated. Main always does, since its body declares the
+  // functions of every partition.
+  bool in_partition(const FunDecl &decl) const;
+
   // Generate the LLVM IR code corresponding to a function
   // declaration. If inner function declarations are encountered,
   // they will be stored into pending_func_bodies for later
@@ -92,6 +106,39 @@ class IRGenerator : public ConstASTValueVisitor {
   // in an outer scope.
   llvm::Value *address_of(const Identifier &id);
 
+  // Return a string constant with the given value, emitted once per
+  // module.
+  llvm::Constant *string_constant(const std::string &value);
+
+  // Return the type of the header preceding the bytes of every
+  // string, as laid out by the runtime.
+  llvm::StructType *string_header_type();
+
+  // Generate an i1 telling whether two strings are equal. Identical
+  // strings and strings of different lengths are told apart inline,
+  // and __streq only compares the bytes of the others.
+  llvm::Value *generate_string_equality(llvm::Value *l, llvm::Value *r);
+
+  // Generate an i32 ordering two strings like __strcmp. Identical
+  // strings compare equal inline, and __strcmp compares the bytes of
+  // the others.
+  llvm::Value *generate_string_order(llvm::Value *l, llvm::Value *r);
+
+  // Generate the short-circuit evaluation of a `&' (is_and true)
+  // or `|' (is_and false) operator, as desugared by the parser. The
+  // right operand is only evaluated when needed, and both paths are
+  // joined through a phi node rather than a temporary stack slot.
+  llvm::Value *generate_logical(const Expr &left, const Expr &right,
+                                bool is_and);
+
+  // Generate ord(chr(x)) and ord(getchar()) without going through
+  // a string, or return nullptr if call is not one of those.
+  llvm::Value *generate_ord(const FunCall &call);
+
+  // Return a fresh loop ID, enabling vectorization, to attach to the
+  // back edge of a counted loop.
+  llvm::MDNode *loop_metadata();
+
 public:
   // Constructor
   IRGenerator();
@@ -106,6 +153,50 @@ public:
   // Save the IR into a file whose name is given as argument.
   void write_object(std::string filename);
 
+  // Generate the LLVM IR for the bodies of the given units, functions
+  // declared in main, and of their inner functions, and for the body
+  // of main if with_main is set. Other functions are only declared.
+  // Without main, only the units in declared (all those of main) are
+  // visited, and the rest of main's body is not generated at all.
+  // Functions get hidden external linkage, so that the objects of
+  // complementary partitions can be linked together.
+  void generate_partition(FunDecl *main,
+                          const std::vector<const FunDecl *> &declared,
+                          const std::unordered_set<const FunDecl *> &units,
+                          bool with_main);
+
+  // Save the IR into an object file like write_object, in a way
+  // that allows several generators to do so concurrently.
+  void emit_object(const std::string &filename);
+
+  // Save the IR into an object file like write_object, running the
+  // backend on the object_partitions partitions of the module with
+  // up to threads threads. The output does not depend on threads.
+  void write_object_split(const std::string &filename, unsigned threads);
+
+  // Hand the generated module over to an in-process JIT, with the
+  // primitives resolved against the runtime linked into dtiger.
+  // The module is no longer available afterwards.
+  std::unique_ptr<llvm::ExecutionEngine> create_jit();
+
+  // Generate the LLVM IR for the bodies of functions declared in the
+  // same function and of their inner functions, with nothing else
+  // but declarations. The frame of the enclosing function is opaque,
+  // so none of them may use its static link beyond passing it on to
+  // the others.
+  void generate_functions(const std::vector<const FunDecl *> &decls);
+
+  // Generate an entry point for a function with a body that can be
+  // called from C++ as void (*)(void *args, void *result). Arguments
+  // are read from consecutive 8-byte slots and the result is stored
+  // in the first bytes of result. The function must not use its
+  // static link, which is null. Return the entry point name.
+  std::string generate_entry_point(const FunDecl &decl);
+
+  // JIT-compile the program and run its main function in-process.
+  // Return the status returned by main.
+  int run_main();
+
   // Generate the IR corresponding to those AST nodes.
   // Those methods will return either nullptr when no
   // result is expected (a statement for example),
@@ -0,0 +1,98 @@
+#include "irgen.hh"
+#include "../runtime/runtime.hh"
+#include "../utils/errors.hh"
+
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/TargetSelect.h"
+
+namespace irgen {
+
+std::unique_ptr<llvm::ExecutionEngine> IRGenerator::create_jit() {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  llvm::InitializeNativeTargetAsmParser();
+
+  // Resolve the primitives against the runtime linked into dtiger.
+  for (const runtime::symbol *s = runtime::symbols; s->name; s++)
+    llvm::sys::DynamicLibrary::AddSymbol(s->name, s->address);
+
+  // MCJIT rather than ORC: the ORC layers changed their interfaces
+  // with every release between LLVM 3.8 and 5.0, the versions this
+  // tree builds with, while EngineBuilder stayed the same. The whole
+  // module is compiled at once either way.
+  std::string error;
+  std::unique_ptr<llvm::ExecutionEngine> engine(
+      llvm::EngineBuilder(std::move(Mod))
+          .setEngineKind(llvm::EngineKind::JIT)
+          .setErrorStr(&error)
+          .create());
+  if (!engine)
+    utils::error("cannot create JIT: " + error);
+  engine->finalizeObject();
+  return engine;
+}
+
+void IRGenerator::generate_functions(
+    const std::vector<const FunDecl *> &decls) {
+  const FunDecl &parent = decls.front()->get_parent().get();
+  frame_type[&parent] = llvm::StructType::create(
+      Context, "frame_" + parent.get_external_name().get());
+  for (auto decl : decls)
+    decl->accept(*this);
+  while (!pending_func_bodies.empty()) {
+    const FunDecl *const decl = pending_func_bodies.front();
+    pending_func_bodies.pop_front();
+    generate_function(*decl);
+  }
+}
+
+std::string IRGenerator::generate_entry_point(const FunDecl &decl) {
+  llvm::Function *const callee =
+      Mod->getFunction(decl.get_external_name().get());
+  llvm::FunctionType *const callee_type = callee->getFunctionType();
+
+  llvm::Type *const slots_type = Builder.getInt64Ty()->getPointerTo();
+  llvm::FunctionType *const ft = llvm::FunctionType::get(
+      Builder.getVoidTy(), {slots_type, slots_type}, false);
+  llvm::Function *const entry_point =
+      llvm::Function::Create(ft, llvm::Function::ExternalLinkage,
+                             "__entry_" + decl.get_external_name().get(),
+                             Mod.get());
+  auto arg = entry_point->arg_begin();
+  llvm::Value *const args = &*arg++;
+  llvm::Value *const result = &*arg;
+
+  Builder.SetInsertPoint(
+      llvm::BasicBlock::Create(Context, "entry", entry_point));
+  std::vector<llvm::Value *> args_values;
+  args_values.push_back(
+      llvm::Constant::getNullValue(callee_type->getParamType(0)));
+  for (unsigned i = 1; i < callee_type->getNumParams(); i++) {
+    llvm::Value *const slot = Builder.CreateBitCast(
+        Builder.CreateConstGEP1_32(args, i - 1),
+        callee_type->getParamType(i)->getPointerTo());
+    args_values.push_back(Builder.CreateLoad(slot));
+  }
+  llvm::Value *const value = Builder.CreateCall(callee, args_values);
+  if (decl.get_type() != t_void)
+    Builder.CreateStore(value, Builder.CreateBitCast(
+                                   result, value->getType()->getPointerTo()));
+  Builder.CreateRetVoid();
+
+  return entry_point->getName().str();
+}
+
+int IRGenerator::run_main() {
+  std::unique_ptr<llvm::ExecutionEngine> engine = create_jit();
+  auto const main = reinterpret_cast<int32_t (*)()>(
+      engine->getFunctionAddress("main"));
+  if (!main)
+    utils::error("cannot find main in the generated code");
+  const int32_t status = main();
+  __flush();
+  return status;
+}
+
+} // namespace irgen
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "irgen.hh"
+#include "objects.hh"
+#include "../utils/errors.hh"
+
+#include "llvm/Config/llvm-config.h"
+#if LLVM_VERSION_MAJOR >= 4
+#include "llvm/Bitcode/BitcodeWriter.h"
+#else
+#include "llvm/Bitcode/ReaderWriter.h"
+#endif
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+namespace irgen {
+
+namespace {
+
+std::string to_bitcode(const llvm::Module &module) {
+  std::string bitcode;
+  llvm::raw_string_ostream out(bitcode);
+  llvm::WriteBitcodeToFile(&module, out);
+  out.flush();
+  return bitcode;
+}
+
+std::unique_ptr<llvm::Module> from_bitcode(const std::string &bitcode,
+                                           llvm::LLVMContext &context) {
+  llvm::SMDiagnostic diagnostic;
+  std::unique_ptr<llvm::Module> module = llvm::parseIR(
+      llvm::MemoryBufferRef(bitcode, "partition"), diagnostic, context);
+  if (!module)
+    utils::error("cannot read back generated code: " +
+                 diagnostic.getMessage().str());
+  return module;
+}
+
+// Run a command, and report message as an error if it fails.
+void run_command(std::vector<const char *> argv, const std::string &message) {
+  argv.push_back(nullptr);
+  const pid_t pid = fork();
+  if (pid < 0)
+    utils::error(std::string("cannot run ") + argv[0]);
+  if (pid == 0) {
+    execvp(argv[0], const_cast<char *const *>(argv.data()));
+    _exit(127);
+  }
+  int status;
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+      WEXITSTATUS(status))
+    utils::error(message);
+}
+
+} // namespace
+
+void run_jobs(size_t count, unsigned threads,
+              const std::function<void(size_t)> &job) {
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < std::min<size_t>(std::max(threads, 1U), count);
+       t++)
+    workers.emplace_back([&] {
+      for (size_t k; (k = next++) < count;)
+        job(k);
+    });
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void initialize_native_target() {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+  });
+}
+
+void emit_object_file(llvm::Module &module, const std::string &filename) {
+  initialize_native_target();
+
+  const std::string triple = llvm::sys::getDefaultTargetTriple();
+  std::string error;
+  const llvm::Target *const target =
+      llvm::TargetRegistry::lookupTarget(triple, error);
+  if (!target)
+    utils::error(error);
+
+  llvm::TargetOptions options;
+  std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(
+      triple, "generic", "", options, llvm::Reloc::PIC_));
+  module.setTargetTriple(triple);
+  module.setDataLayout(machine->createDataLayout());
+
+  std::error_code ec;
+  llvm::raw_fd_ostream out(filename, ec, llvm::sys::fs::F_None);
+  if (ec)
+    utils::error("cannot open " + filename + ": " + ec.message());
+
+  llvm::legacy::PassManager passes;
+  if (machine->addPassesToEmitFile(passes, out,
+                                   llvm::TargetMachine::CGFT_ObjectFile))
+    utils::error("cannot emit object files for " + triple);
+  passes.run(module);
+  out.flush();
+}
+
+void merge_objects(const std::vector<std::string> &inputs,
+                   const std::string &output) {
+  std::vector<const char *> argv = {"ld", "-r", "-o", output.c_str()};
+  for (auto &input : inputs)
+    argv.push_back(input.c_str());
+  run_command(argv, "cannot merge object files into " + output);
+}
+
+void link_executable(const std::string &object, const std::string &output) {
+  const char *runtime = getenv("TIGER_RUNTIME");
+  if (!runtime)
+    runtime = RUNTIME_LIBRARY;
+  // The runtime is written in C++, and its collector inspects the
+  // thread stack.
+  run_command({"c++", "-pthread", "-o", output.c_str(), object.c_str(),
+               runtime},
+              "cannot link " + output);
+}
+
+void IRGenerator::emit_object(const std::string &filename) {
+  emit_object_file(*Mod, filename);
+}
+
+void IRGenerator::write_object_split(const std::string &filename,
+                                     unsigned threads) {
+  // Split a copy, so that the module stays available. Partitions
+  // share the context of the module they are split from, and are
+  // moved to their own context through bitcode to be emitted
+  // concurrently. The partitioning only depends on global names.
+  std::vector<std::string> partitions;
+  {
+    llvm::LLVMContext context;
+    llvm::SplitModule(from_bitcode(to_bitcode(*Mod), context),
+                      object_partitions,
+                      [&partitions](std::unique_ptr<llvm::Module> part) {
+                        partitions.push_back(to_bitcode(*part));
+                      });
+  }
+
+  std::vector<std::string> parts;
+  for (size_t k = 0; k < partitions.size(); k++)
+    parts.push_back(filename + ".part" + std::to_string(k) + ".o");
+
+  initialize_native_target();
+  run_jobs(partitions.size(), threads, [&](size_t k) {
+    llvm::LLVMContext context;
+    emit_object_file(*from_bitcode(partitions[k], context), parts[k]);
+  });
+
+  merge_objects(parts, filename);
+  for (auto &part : parts)
+    std::remove(part.c_str());
+}
+
+} // namespace irgen
@@ -0,0 +1,60 @@
+#ifndef OBJECTS_HH
+#define OBJECTS_HH
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../ast/nodes.hh"
+
+namespace llvm {
+class Module;
+} // namespace llvm
+
+namespace irgen {
+using namespace ast::types;
+
+// Number of partitions of a program whose object code is generated
+// concurrently. It does not depend on the number of threads, so that
+// neither does the object code.
+const unsigned object_partitions = 8;
+
+// Run job(0) to job(count - 1) on up to threads threads at once.
+void run_jobs(size_t count, unsigned threads,
+              const std::function<void(size_t)> &job);
+
+// Make the native target available. This is done once, and may be
+// called from several threads.
+void initialize_native_target();
+
+// Emit a module into an object file for the native target. Modules
+// living in different contexts may be emitted concurrently.
+void emit_object_file(llvm::Module &module, const std::string &filename);
+
+// Link object files into a single relocatable object file, with
+// the inputs laid out in the given order.
+void merge_objects(const std::vector<std::string> &inputs,
+                   const std::string &output);
+
+// Link a position-independent object file holding main with the
+// Tiger runtime into an executable. The runtime library is
+// $TIGER_RUNTIME if set, and the one built with dtiger otherwise.
+void link_executable(const std::string &object, const std::string &output);
+
+// Generate the object file of a program with up to threads IR
+// generators running concurrently, each in its own context, on the
+// object_partitions partitions of the functions declared in main.
+void write_object_parallel(FunDecl *main, unsigned threads,
+                           const std::string &filename);
+
+// Generate the object file of a program, reusing from a cache
+// directory the object code of every function declared in main
+// (with its inner functions) and of the rest of main when neither
+// their structure nor the declarations they depend on changed. The
+// missing object code is generated with up to threads threads.
+void write_object_cached(FunDecl *main, const std::string &cache_dir,
+                         unsigned threads, const std::string &filename);
+
+} // namespace irgen
+
+#endif // OBJECTS_HH
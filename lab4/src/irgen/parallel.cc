@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+
+#include "irgen.hh"
+#include "objects.hh"
+
+namespace irgen {
+
+namespace {
+
+// Partition generated on this thread: the generator doing it, and
+// the functions declared in main whose bodies it generates, along
+// with those of their inner functions. It is kept out of IRGenerator,
+// whose layout is that of the prebuilt libirgenutils.a.
+struct Partition {
+  const IRGenerator *generator;
+  const std::unordered_set<const FunDecl *> *units;
+};
+
+thread_local Partition current_partition = {nullptr, nullptr};
+
+// Estimate the code generation cost of every function declared in
+// main, inner functions included, by its number of nodes. Nodes of
+// main outside of those functions are counted in main_size.
+class UnitSizes : public ConstASTVisitor {
+  const FunDecl *main;
+  const FunDecl *unit = nullptr;
+
+  void count() {
+    if (unit)
+      sizes[unit]++;
+    else
+      main_size++;
+  }
+
+public:
+  std::vector<const FunDecl *> units;
+  std::unordered_map<const FunDecl *, size_t> sizes;
+  size_t main_size = 0;
+
+  explicit UnitSizes(const FunDecl *_main) : main(_main) {}
+
+  virtual void visit(const IntegerLiteral &) { count(); }
+  virtual void visit(const StringLiteral &) { count(); }
+  virtual void visit(const BinaryOperator &op) {
+    count();
+    op.get_left().accept(*this);
+    op.get_right().accept(*this);
+  }
+  virtual void visit(const Sequence &seq) {
+    count();
+    for (auto expr : seq.get_exprs())
+      expr->accept(*this);
+  }
+  virtual void visit(const Let &let) {
+    count();
+    for (auto decl : let.get_decls())
+      decl->accept(*this);
+    let.get_sequence().accept(*this);
+  }
+  virtual void visit(const Identifier &) { count(); }
+  virtual void visit(const IfThenElse &ite) {
+    count();
+    ite.get_condition().accept(*this);
+    ite.get_then_part().accept(*this);
+    ite.get_else_part().accept(*this);
+  }
+  virtual void visit(const VarDecl &decl) {
+    count();
+    if (decl.get_expr())
+      decl.get_expr()->accept(*this);
+  }
+  virtual void visit(const FunDecl &decl) {
+    if (!decl.get_expr())
+      return;
+    const bool is_unit = &decl.get_parent().get() == main;
+    if (is_unit) {
+      unit = &decl;
+      units.push_back(&decl);
+    }
+    count();
+    decl.get_expr()->accept(*this);
+    if (is_unit)
+      unit = nullptr;
+  }
+  virtual void visit(const FunCall &call) {
+    count();
+    for (auto arg : call.get_args())
+      arg->accept(*this);
+  }
+  virtual void visit(const WhileLoop &loop) {
+    count();
+    loop.get_condition().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const ForLoop &loop) {
+    count();
+    loop.get_variable().accept(*this);
+    loop.get_high().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const Break &) { count(); }
+  virtual void visit(const Assign &assign) {
+    count();
+    assign.get_rhs().accept(*this);
+  }
+};
+
+} // namespace
+
+bool IRGenerator::partitioned() const {
+  return current_partition.generator == this;
+}
+
+bool IRGenerator::in_partition(const FunDecl &decl) const {
+  if (!partitioned())
+    return true;
+  const FunDecl *unit = &decl;
+  while (unit->get_parent() && unit->get_parent().get().get_parent())
+    unit = &unit->get_parent().get();
+  return !unit->get_parent() || current_partition.units->count(unit);
+}
+
+void IRGenerator::generate_partition(
+    FunDecl *main, const std::vector<const FunDecl *> &declared,
+    const std::unordered_set<const FunDecl *> &units, bool with_main) {
+  struct Reset {
+    ~Reset() { current_partition = {nullptr, nullptr}; }
+  } reset;
+  current_partition = {this, &units};
+  if (with_main) {
+    generate_program(main);
+    return;
+  }
+
+  // Only lay out the frame of main, which the units reach through
+  // their static links, the way generate_function does, and leave
+  // main a declaration.
+  main->accept(*this);
+  pending_func_bodies.clear();
+  current_function = Mod->getFunction(main->get_external_name().get());
+  current_function_decl = main;
+  Builder.SetInsertPoint(
+      llvm::BasicBlock::Create(Context, "entry", current_function));
+  generate_frame();
+  for (auto decl : main->get_escaping_decls())
+    generate_vardecl(*decl);
+  current_function->deleteBody();
+
+  for (auto decl : declared)
+    decl->accept(*this);
+  while (!pending_func_bodies.empty()) {
+    const FunDecl *const decl = pending_func_bodies.front();
+    pending_func_bodies.pop_front();
+    generate_function(*decl);
+  }
+}
+
+void write_object_parallel(FunDecl *main, unsigned threads,
+                           const std::string &filename) {
+  UnitSizes sizes(main);
+  main->get_expr()->accept(sizes);
+
+  // Hand the largest units out first, each to the least loaded
+  // partition. Ties are broken by declaration order, so that the
+  // output does not depend on scheduling.
+  std::vector<const FunDecl *> units = sizes.units;
+  std::stable_sort(units.begin(), units.end(),
+                   [&sizes](const FunDecl *a, const FunDecl *b) {
+                     return sizes.sizes[a] > sizes.sizes[b];
+                   });
+  const size_t count = std::max<size_t>(
+      1, std::min<size_t>(object_partitions, units.size()));
+  std::vector<std::unordered_set<const FunDecl *>> partitions(count);
+  std::vector<size_t> loads(count, 0);
+  loads[0] = sizes.main_size;
+  for (auto unit : units) {
+    const size_t k = std::min_element(loads.begin(), loads.end()) -
+                     loads.begin();
+    partitions[k].insert(unit);
+    loads[k] += sizes.sizes[unit];
+  }
+
+  std::vector<std::string> parts;
+  for (size_t k = 0; k < count; k++)
+    parts.push_back(filename + ".part" + std::to_string(k) + ".o");
+
+  // The AST is only read by the generators.
+  initialize_native_target();
+  run_jobs(count, threads, [&](size_t k) {
+    IRGenerator generator;
+    generator.generate_partition(main, sizes.units, partitions[k], k == 0);
+    generator.emit_object(parts[k]);
+  });
+
+  merge_objects(parts, filename);
+  for (auto &part : parts)
+    std::remove(part.c_str());
+}
+
+} // namespace irgen
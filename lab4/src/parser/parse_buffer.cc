@@ -0,0 +1,38 @@
+#include "parser_driver.hh"
+#include "../utils/errors.hh"
+
+// Interface of the Flex lexer.
+struct yy_buffer_state;
+yy_buffer_state *yy_scan_buffer(char *base, size_t size);
+void yyset_debug(int debug);
+int yylex_destroy();
+
+// The lexer is left in its initial state, even on errors, except
+// for its position, which it never resets. The position where the
+// buffer starts is found by scanning a single token first, and
+// locations are reported relative to it.
+bool ParserDriver::parse_buffer(char *buffer, size_t size,
+                                const std::string &name) {
+  file = name;
+  char probe[] = {'0', '\0', '\0'};
+  if (!yy_scan_buffer(probe, sizeof(probe)))
+    utils::error(file + ": invalid buffer");
+  yyset_debug(0);
+  utils::set_location_origin(yylex(*this).location.end);
+  yylex_destroy();
+
+  if (!yy_scan_buffer(buffer, size + 2))
+    utils::error(file + ": invalid buffer");
+  yyset_debug(trace_lexer);
+  yy::tiger_parser parser(*this);
+  parser.set_debug_level(trace_parser);
+  int res;
+  try {
+    res = parser.parse();
+  } catch (const utils::Error &) {
+    yylex_destroy();
+    throw;
+  }
+  yylex_destroy();
+  return res == 0;
+}
@@ -28,6 +28,12 @@ public:
   // Returns true on success.
   bool parse(const std::string &f);
 
+  // Run the parser on the size bytes at buffer without copying them.
+  // The lexer needs to write into the buffer, which must be followed
+  // by two null bytes. name is used as the file name.
+  // Returns true on success.
+  bool parse_buffer(char *buffer, size_t size, const std::string &name);
+
   // The name of the file being parsed.
   // Used later to pass the file name to the location tracker.
   std::string file;
@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <pthread.h>
+#include <unordered_map>
+#include <vector>
+
+#include "memory.hh"
+
+namespace runtime {
+
+namespace {
+
+const size_t alignment = 16;
+
+size_t round_up(size_t size, size_t to) { return (size + to - 1) / to * to; }
+
+void *aligned_block(size_t alignment, size_t size) {
+  void *block;
+  return posix_memalign(&block, alignment, size) ? nullptr : block;
+}
+
+bool collecting() {
+  static const bool enabled = [] {
+    const char *const gc = getenv("TIGER_GC");
+    return gc && *gc && strcmp(gc, "0");
+  }();
+  return enabled;
+}
+
+std::atomic<size_t> region_bytes{0};
+
+// Memory handed out by bumping a pointer through blocks, which are
+// all released together.
+class Region {
+  static const size_t block_size = 1 << 20;
+  std::vector<void *> blocks;
+  char *next = nullptr;
+  char *limit = nullptr;
+
+  void *new_block(size_t size) {
+    void *const block = aligned_block(alignment, size);
+    if (block) {
+      blocks.push_back(block);
+      region_bytes += size;
+    }
+    return block;
+  }
+
+public:
+  ~Region() {
+    for (auto block : blocks)
+      free(block);
+  }
+
+  void *allocate(size_t size) {
+    size = round_up(size, alignment);
+    if (size_t(limit - next) >= size) {
+      void *const p = next;
+      next += size;
+      return p;
+    }
+    // Large objects get a block of their own, so that the current
+    // block is not abandoned.
+    if (size > block_size / 4)
+      return new_block(size);
+    char *const block = static_cast<char *>(new_block(block_size));
+    if (!block)
+      return nullptr;
+    next = block + size;
+    limit = block + block_size;
+    return block;
+  }
+};
+
+thread_local Region region;
+
+// A heap of objects segregated in size classes, each living in
+// chunks aligned on their size so that the object containing any
+// address can be found, and of large objects allocated one by one.
+class Heap {
+  static const size_t chunk_size = 1 << 20;
+  static const size_t largest_small = 4096;
+  static const size_t collection_threshold = 4 << 20;
+
+  struct Chunk {
+    size_t object_size;
+    char *begin;
+    // Objects below bump are either allocated or in a free list.
+    char *bump;
+    std::vector<bool> marks;
+  };
+
+  struct SizeClass {
+    size_t object_size;
+    Chunk *chunk = nullptr;
+    void *free_list = nullptr;
+  };
+
+  struct LargeObject {
+    size_t size;
+    bool marked;
+  };
+
+  std::vector<SizeClass> classes;
+  // Index into classes of the class of every size, in units of the
+  // alignment.
+  std::vector<uint8_t> class_of;
+  std::unordered_map<uintptr_t, Chunk *> chunks;
+  std::map<uintptr_t, LargeObject> large_objects;
+  // Bounds of the addresses ever allocated, to reject most other
+  // words quickly while marking.
+  uintptr_t lowest = UINTPTR_MAX;
+  uintptr_t highest = 0;
+  std::vector<std::pair<const void *const *, const void *const *>> roots;
+
+  // Bytes allocated since the last collection, and threshold
+  // triggering the next one.
+  size_t allocated = 0;
+  size_t threshold = collection_threshold;
+  size_t heap_bytes = 0;
+  size_t live_bytes = 0;
+  unsigned long collections = 0;
+
+  std::vector<std::pair<char *, size_t>> mark_stack;
+
+  void *allocate_large(size_t size);
+  void extend_bounds(const void *p, size_t size) {
+    lowest = std::min(lowest, uintptr_t(p));
+    highest = std::max(highest, uintptr_t(p) + size);
+  }
+  void *refill(SizeClass &size_class);
+  void collect();
+  void mark_stack_and_roots();
+  void mark_range(const void *begin, const void *end);
+  void mark(uintptr_t p);
+  void sweep();
+
+public:
+  Heap();
+  void *allocate(size_t size);
+  void add_roots(const void *const *begin, const void *const *end) {
+    roots.emplace_back(begin, end);
+  }
+  void remove_roots(const void *const *begin) {
+    for (auto r = roots.begin(); r != roots.end(); ++r)
+      if (r->first == begin) {
+        roots.erase(r);
+        return;
+      }
+  }
+  MemoryStats stats() const {
+    return {true, collections, heap_bytes, live_bytes};
+  }
+};
+
+Heap::Heap() {
+  for (size_t size : {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024,
+                      1536, 2048, 3072, 4096}) {
+    classes.emplace_back();
+    classes.back().object_size = size;
+  }
+  for (size_t units = 0; units <= largest_small / alignment; units++) {
+    uint8_t c = 0;
+    while (classes[c].object_size < units * alignment)
+      c++;
+    class_of.push_back(c);
+  }
+}
+
+void *Heap::allocate(size_t size) {
+  // An object must also contain the address just past its end.
+  size += 1;
+  if (allocated >= threshold)
+    collect();
+  allocated += size;
+  if (size > largest_small)
+    return allocate_large(size);
+  SizeClass &size_class = classes[class_of[(size + alignment - 1) / alignment]];
+  if (void *const p = size_class.free_list) {
+    size_class.free_list = *static_cast<void **>(p);
+    return p;
+  }
+  Chunk *const chunk = size_class.chunk;
+  if (chunk && chunk->bump + size_class.object_size <= chunk->begin + chunk_size) {
+    void *const p = chunk->bump;
+    chunk->bump += size_class.object_size;
+    return p;
+  }
+  return refill(size_class);
+}
+
+void *Heap::refill(SizeClass &size_class) {
+  char *const block = static_cast<char *>(aligned_block(chunk_size, chunk_size));
+  if (!block)
+    return nullptr;
+  Chunk *const chunk = new Chunk;
+  chunk->object_size = size_class.object_size;
+  chunk->begin = block;
+  chunk->bump = block + chunk->object_size;
+  chunk->marks.resize(chunk_size / chunk->object_size);
+  chunks[uintptr_t(block)] = chunk;
+  extend_bounds(block, chunk_size);
+  heap_bytes += chunk_size;
+  size_class.chunk = chunk;
+  return block;
+}
+
+void *Heap::allocate_large(size_t size) {
+  size = round_up(size, alignment);
+  void *const p = aligned_block(alignment, size);
+  if (p) {
+    large_objects[uintptr_t(p)] = {size, false};
+    extend_bounds(p, size);
+    heap_bytes += size;
+  }
+  return p;
+}
+
+void Heap::mark(uintptr_t p) {
+  if (p < lowest || p >= highest)
+    return;
+  auto chunk = chunks.find(p & ~uintptr_t(chunk_size - 1));
+  if (chunk != chunks.end()) {
+    Chunk &c = *chunk->second;
+    if (p >= uintptr_t(c.bump))
+      return;
+    const size_t index = (p - uintptr_t(c.begin)) / c.object_size;
+    if (c.marks[index])
+      return;
+    c.marks[index] = true;
+    mark_stack.emplace_back(c.begin + index * c.object_size, c.object_size);
+    return;
+  }
+  auto large = large_objects.upper_bound(p);
+  if (large == large_objects.begin())
+    return;
+  --large;
+  if (p >= large->first + large->second.size || large->second.marked)
+    return;
+  large->second.marked = true;
+  mark_stack.emplace_back(reinterpret_cast<char *>(large->first),
+                          large->second.size);
+}
+
+void Heap::mark_range(const void *begin, const void *end) {
+  const uintptr_t first = round_up(uintptr_t(begin), sizeof(uintptr_t));
+  for (uintptr_t w = first; w + sizeof(uintptr_t) <= uintptr_t(end);
+       w += sizeof(uintptr_t))
+    mark(*reinterpret_cast<const uintptr_t *>(w));
+}
+
+// Return the highest address of the stack of the current thread.
+const void *stack_base() {
+  thread_local const void *base = nullptr;
+  if (!base) {
+    pthread_attr_t attributes;
+    void *address;
+    size_t size;
+    pthread_getattr_np(pthread_self(), &attributes);
+    pthread_attr_getstack(&attributes, &address, &size);
+    pthread_attr_destroy(&attributes);
+    base = static_cast<char *>(address) + size;
+  }
+  return base;
+}
+
+// Kept out of line, so that the registers spilled by collect lie
+// between its frame and the base of the stack.
+__attribute__((noinline)) void Heap::mark_stack_and_roots() {
+  const void *const top = &top;
+  mark_range(top, stack_base());
+  for (auto &range : roots)
+    mark_range(*range.first, *range.second);
+  // Objects may hold pointers anywhere in their bytes.
+  while (!mark_stack.empty()) {
+    const std::pair<char *, size_t> object = mark_stack.back();
+    mark_stack.pop_back();
+    mark_range(object.first, object.first + object.second);
+  }
+}
+
+void Heap::sweep() {
+  live_bytes = 0;
+  for (auto &size_class : classes)
+    size_class.free_list = nullptr;
+  for (auto c = chunks.begin(); c != chunks.end();) {
+    Chunk *const chunk = c->second;
+    SizeClass &size_class = classes[class_of[chunk->object_size / alignment]];
+    const size_t count = (chunk->bump - chunk->begin) / chunk->object_size;
+    size_t live = 0;
+    for (size_t i = 0; i < count; i++)
+      live += chunk->marks[i];
+    if (!live && chunk != size_class.chunk) {
+      free(chunk->begin);
+      delete chunk;
+      heap_bytes -= chunk_size;
+      c = chunks.erase(c);
+      continue;
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (chunk->marks[i]) {
+        chunk->marks[i] = false;
+        continue;
+      }
+      void **const p =
+          reinterpret_cast<void **>(chunk->begin + i * chunk->object_size);
+      *p = size_class.free_list;
+      size_class.free_list = p;
+    }
+    live_bytes += live * chunk->object_size;
+    ++c;
+  }
+  for (auto o = large_objects.begin(); o != large_objects.end();) {
+    if (o->second.marked) {
+      o->second.marked = false;
+      live_bytes += o->second.size;
+      ++o;
+      continue;
+    }
+    free(reinterpret_cast<void *>(o->first));
+    heap_bytes -= o->second.size;
+    o = large_objects.erase(o);
+  }
+}
+
+void Heap::collect() {
+  // Spill the callee-saved registers, which may hold the only
+  // references to some objects, into this frame.
+  __builtin_unwind_init();
+  mark_stack_and_roots();
+  sweep();
+  collections++;
+  allocated = 0;
+  threshold =
+      live_bytes > collection_threshold ? live_bytes : collection_threshold;
+}
+
+Heap &heap() {
+  // Never destroyed, since strings may be used until the very end.
+  static Heap *const heap = new Heap;
+  return *heap;
+}
+
+} // namespace
+
+void *allocate(size_t size) {
+  return collecting() ? heap().allocate(size) : region.allocate(size);
+}
+
+Roots::Roots(const void *_begin, const void *_end)
+    : bounds{_begin, _end}, begin(&bounds[0]), end(&bounds[1]) {
+  if (collecting())
+    heap().add_roots(begin, end);
+}
+
+Roots::Roots(const void *const *_begin, const void *const *_end)
+    : begin(_begin), end(_end) {
+  if (collecting())
+    heap().add_roots(begin, end);
+}
+
+Roots::~Roots() {
+  if (collecting())
+    heap().remove_roots(begin);
+}
+
+MemoryStats memory_stats() {
+  if (collecting())
+    return heap().stats();
+  return {false, 0, region_bytes, 0};
+}
+
+} // namespace runtime
@@ -0,0 +1,53 @@
+#ifndef MEMORY_HH
+#define MEMORY_HH
+
+#include <cstddef>
+
+// Memory of the strings built by the runtime. By default, strings
+// are allocated from regions owned by the allocating thread, which
+// are released when it exits. When TIGER_GC is set to a non-empty
+// value other than 0, they are allocated from a heap segregated in
+// size classes and reclaimed by a conservative mark-sweep collector,
+// which scans the stack and registers of the thread calling
+// allocate, the registered roots, and the live objects. In this
+// mode, strings must be allocated by a single thread at a time.
+
+namespace runtime {
+
+// Allocate size bytes, aligned on 16 bytes, or return nullptr if
+// there is no memory left. Pointers into or just past the end of the
+// memory keep it alive.
+void *allocate(size_t size);
+
+// Keep alive the memory referenced from [begin, end) while it
+// exists, for runtime values stored out of the machine stack.
+class Roots {
+  const void *bounds[2];
+  const void *const *const begin;
+  const void *const *const end;
+
+public:
+  Roots(const void *begin, const void *end);
+  // Read the bounds from *begin and *end at every collection
+  // instead, for storage which moves, or of which only a prefix is
+  // in use.
+  Roots(const void *const *begin, const void *const *end);
+  ~Roots();
+  Roots(const Roots &) = delete;
+  Roots &operator=(const Roots &) = delete;
+};
+
+struct MemoryStats {
+  bool collecting;
+  unsigned long collections;
+  // Bytes obtained from the system.
+  size_t heap_bytes;
+  // Bytes found alive by the last collection.
+  size_t live_bytes;
+};
+
+MemoryStats memory_stats();
+
+} // namespace runtime
+
+#endif // MEMORY_HH
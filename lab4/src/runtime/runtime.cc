@@ -0,0 +1,511 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "memory.hh"
+#include "runtime.hh"
+
+namespace {
+
+// Standard output is written by the primitives only, through this
+// buffer, which is flushed when full, by flush, and when the program
+// exits. The buffer is also flushed before reading an interactive
+// standard input, so that prompts are shown.
+class Output {
+  static const size_t capacity = 1 << 16;
+  char buffer[capacity];
+  size_t used = 0;
+
+public:
+  ~Output() { flush(); }
+
+  void flush() {
+    const char *data = buffer;
+    while (used) {
+      const ssize_t written = write(STDOUT_FILENO, data, used);
+      if (written < 0) {
+        if (errno == EINTR)
+          continue;
+        // Output is lost, like with stdio.
+        break;
+      }
+      data += written;
+      used -= written;
+    }
+    used = 0;
+  }
+
+  // Return room for at least count bytes, which must not exceed the
+  // capacity, to be committed with commit.
+  char *reserve(size_t count) {
+    if (capacity - used < count)
+      flush();
+    return buffer + used;
+  }
+
+  void commit(size_t count) { used += count; }
+
+  void append(const char *s, size_t length) {
+    while (length) {
+      const size_t chunk = length < capacity ? length : capacity;
+      memcpy(reserve(chunk), s, chunk);
+      commit(chunk);
+      s += chunk;
+      length -= chunk;
+    }
+  }
+};
+
+Output output;
+
+// Standard input is read by the primitives only, through this
+// buffer. Output is flushed before waiting for an interactive
+// standard input.
+class Input {
+  static const size_t capacity = 1 << 16;
+  char buffer[capacity];
+  size_t begin = 0;
+  size_t end = 0;
+
+public:
+  // Return the bytes buffered, refilling the buffer if it is empty.
+  // Return false at the end of the input.
+  bool fill() {
+    if (begin < end)
+      return true;
+    static const bool interactive = isatty(STDIN_FILENO);
+    if (interactive)
+      output.flush();
+    ssize_t count;
+    do
+      count = read(STDIN_FILENO, buffer, capacity);
+    while (count < 0 && errno == EINTR);
+    begin = 0;
+    end = count > 0 ? count : 0;
+    return end;
+  }
+
+  const char *data() const { return buffer + begin; }
+  size_t available() const { return end - begin; }
+  void consume(size_t count) { begin += count; }
+
+  // Return the next byte, or -1 at the end of the input.
+  int get() {
+    return fill() ? static_cast<unsigned char>(buffer[begin++]) : -1;
+  }
+
+  // Return the next byte without consuming it, or -1 at the end of
+  // the input.
+  int peek() {
+    return fill() ? static_cast<unsigned char>(buffer[begin]) : -1;
+  }
+};
+
+Input input;
+
+// "00" to "99", to format integers two digits at a time.
+const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "68697071727374757677787980818283848586878889909192939495969798"
+    "99";
+
+[[noreturn]] void runtime_error(const char *message) {
+  output.flush();
+  fprintf(stderr, "%s\n", message);
+  exit(EXIT_FAILURE);
+}
+
+using runtime::length;
+using runtime::string_header;
+
+// Concatenations shorter than this are copied right away rather
+// than represented as ropes.
+const int32_t rope_threshold = 64;
+
+// A concatenation whose bytes are only gathered when they are
+// needed. The string points after the header, like any other.
+struct rope {
+  const char *left;
+  const char *right;
+  string_header header;
+};
+
+void *allocate(size_t size) {
+  void *const p = runtime::allocate(size);
+  if (!p)
+    runtime_error("out of memory");
+  return p;
+}
+
+string_header *header_of(const char *s) {
+  return const_cast<string_header *>(
+      reinterpret_cast<const string_header *>(s) - 1);
+}
+
+void check_length(size_t length) {
+  if (length > INT32_MAX)
+    runtime_error("string too long");
+}
+
+// Size of the memory of a flat string of the given length.
+size_t string_size(size_t length) {
+  check_length(length);
+  return sizeof(string_header) + length + 1;
+}
+
+// Initialize the header of a flat string of the given length in
+// memory, whose bytes are to be filled by the caller.
+char *init_string(void *memory, size_t length) {
+  string_header *const header = static_cast<string_header *>(memory);
+  char *const s = reinterpret_cast<char *>(header + 1);
+  header->bytes = s;
+  header->length = length;
+  s[length] = '\0';
+  return s;
+}
+
+char *allocate_string(size_t length) {
+  return init_string(allocate(string_size(length)), length);
+}
+
+// Gather the bytes of a rope, once.
+const char *flatten(const char *s) {
+  string_header *const header = header_of(s);
+  char *const bytes = static_cast<char *>(allocate(header->length + 1));
+  // Walk the leaves from left to right with an explicit stack, since
+  // ropes built by loops are as deep as they are long.
+  char *p = bytes;
+  std::vector<const char *> pending(1, s);
+  while (!pending.empty()) {
+    const char *const t = pending.back();
+    pending.pop_back();
+    const string_header *const h = header_of(t);
+    if (h->bytes) {
+      memcpy(p, h->bytes, h->length);
+      p += h->length;
+    } else {
+      const rope *const r = reinterpret_cast<const rope *>(
+          reinterpret_cast<const char *>(h) - offsetof(rope, header));
+      pending.push_back(r->right);
+      pending.push_back(r->left);
+    }
+  }
+  *p = '\0';
+  header->bytes = bytes;
+  return bytes;
+}
+
+// Return the bytes of a string.
+const char *bytes_of(const char *s) {
+  const char *const bytes = header_of(s)->bytes;
+  return bytes ? bytes : flatten(s);
+}
+
+// Return the index of the first byte differing between a and b, or
+// count if their first count bytes are equal. Sixteen bytes are
+// compared at a time where SSE2 is available.
+size_t mismatch(const char *a, const char *b, size_t count) {
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 16 <= count; i += 16) {
+    const __m128i x =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    const __m128i y =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    const unsigned equal = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+    if (equal != 0xffff)
+      return i + __builtin_ctz(~equal);
+  }
+#endif
+  while (i < count && a[i] == b[i])
+    i++;
+  return i;
+}
+
+// The empty string, returned by getchar at the end of the input.
+const struct {
+  string_header header;
+  char bytes[1];
+} empty_string = {{empty_string.bytes, 0}, ""};
+
+// The strings of one character, returned by chr and getchar, so that
+// they never allocate.
+const struct character_string {
+  string_header header;
+  char bytes[2];
+} characters[256] = {
+#define CHARACTER(c) {{characters[c].bytes, 1}, {char(c), 0}}
+#define CHARACTERS_4(c)                                                      \
+  CHARACTER(c), CHARACTER(c + 1), CHARACTER(c + 2), CHARACTER(c + 3)
+#define CHARACTERS_16(c)                                                     \
+  CHARACTERS_4(c), CHARACTERS_4(c + 4), CHARACTERS_4(c + 8),                 \
+      CHARACTERS_4(c + 12)
+#define CHARACTERS_64(c)                                                     \
+  CHARACTERS_16(c), CHARACTERS_16(c + 16), CHARACTERS_16(c + 32),            \
+      CHARACTERS_16(c + 48)
+    CHARACTERS_64(0), CHARACTERS_64(64), CHARACTERS_64(128),
+    CHARACTERS_64(192)
+#undef CHARACTERS_64
+#undef CHARACTERS_16
+#undef CHARACTERS_4
+#undef CHARACTER
+};
+
+} // namespace
+
+extern "C" {
+
+void __print_err(const char *s) {
+  output.flush();
+  fwrite(bytes_of(s), 1, length(s), stderr);
+}
+
+void __print(const char *s) { output.append(bytes_of(s), length(s)); }
+
+void __print_int(const int32_t i) {
+  // Digits are produced from the end of a buffer large enough for
+  // the sign and the 10 digits of any int32_t.
+  char digits[11];
+  char *p = digits + sizeof(digits);
+  uint32_t u = i < 0 ? 0U - uint32_t(i) : uint32_t(i);
+  while (u >= 100) {
+    const uint32_t pair = u % 100 * 2;
+    u /= 100;
+    *--p = digit_pairs[pair + 1];
+    *--p = digit_pairs[pair];
+  }
+  if (u >= 10) {
+    *--p = digit_pairs[u * 2 + 1];
+    *--p = digit_pairs[u * 2];
+  } else {
+    *--p = char('0' + u);
+  }
+  if (i < 0)
+    *--p = '-';
+  const size_t length = digits + sizeof(digits) - p;
+  memcpy(output.reserve(length), p, length);
+  output.commit(length);
+}
+
+void __flush(void) { output.flush(); }
+
+const char *__getchar(void) {
+  const int32_t c = __getchar_code();
+  return c < 0 ? empty_string.bytes : characters[c].bytes;
+}
+
+int32_t __getchar_code(void) { return input.get(); }
+
+int32_t __ord(const char *s) {
+  return length(s) ? static_cast<unsigned char>(bytes_of(s)[0]) : -1;
+}
+
+const char *__chr(int32_t i) {
+  if (i < 0 || i > 255)
+    runtime_error("chr: character out of range");
+  return characters[i].bytes;
+}
+
+int32_t __size(const char *s) { return length(s); }
+
+const char *__substring(const char *s, int32_t first, int32_t length) {
+  const int32_t size = runtime::length(s);
+  if (first < 0 || length < 0 || first > size || length > size - first)
+    runtime_error("substring: arguments out of bounds");
+  if (length == size)
+    return s;
+  if (length == 0)
+    return empty_string.bytes;
+  const char *const bytes = bytes_of(s) + first;
+  if (length == 1)
+    return characters[static_cast<unsigned char>(bytes[0])].bytes;
+  // A slice only has a header, pointing into the bytes of s.
+  string_header *const header =
+      static_cast<string_header *>(allocate(sizeof(string_header)));
+  header->bytes = bytes;
+  header->length = length;
+  return reinterpret_cast<const char *>(header + 1);
+}
+
+const char *__concat(const char *s1, const char *s2) {
+  const size_t length1 = length(s1);
+  const size_t length2 = length(s2);
+  if (!length1)
+    return s2;
+  if (!length2)
+    return s1;
+  check_length(length1 + length2);
+  if (length1 + length2 < rope_threshold) {
+    char *const result = allocate_string(length1 + length2);
+    memcpy(result, bytes_of(s1), length1);
+    memcpy(result + length1, bytes_of(s2), length2);
+    return result;
+  }
+  rope *const r = static_cast<rope *>(allocate(sizeof(rope)));
+  r->left = s1;
+  r->right = s2;
+  r->header.bytes = nullptr;
+  r->header.length = length1 + length2;
+  return reinterpret_cast<const char *>(&r->header + 1);
+}
+
+int32_t __strcmp(const char *s1, const char *s2) {
+  const int32_t length1 = length(s1);
+  const int32_t length2 = length(s2);
+  const size_t common = length1 < length2 ? length1 : length2;
+  const char *const bytes1 = bytes_of(s1);
+  const char *const bytes2 = bytes_of(s2);
+  const size_t k = mismatch(bytes1, bytes2, common);
+  if (k < common) {
+    const unsigned char c1 = bytes1[k], c2 = bytes2[k];
+    return c1 < c2 ? -1 : 1;
+  }
+  return length1 < length2 ? -1 : length1 > length2;
+}
+
+int32_t __streq(const char *s1, const char *s2) {
+  const int32_t length1 = length(s1);
+  if (length1 != length(s2))
+    return 0;
+  const char *const bytes1 = bytes_of(s1);
+  const char *const bytes2 = bytes_of(s2);
+  return bytes1 == bytes2 ||
+         mismatch(bytes1, bytes2, length1) == static_cast<size_t>(length1);
+}
+
+int32_t __not(int32_t i) { return !i; }
+
+void __exit(int32_t status) {
+  output.flush();
+  exit(status);
+}
+
+const char *__read_line(void) {
+  std::string line;
+  while (input.fill()) {
+    const char *const data = input.data();
+    const char *const newline =
+        static_cast<const char *>(memchr(data, '\n', input.available()));
+    const size_t count = newline ? newline - data + 1 : input.available();
+    line.append(data, count);
+    input.consume(count);
+    if (newline)
+      break;
+  }
+  if (line.size() <= 1)
+    return line.empty() ? empty_string.bytes
+                        : characters[static_cast<unsigned char>(line[0])].bytes;
+  char *const result = allocate_string(line.size());
+  memcpy(result, line.data(), line.size());
+  return result;
+}
+
+int32_t __read_int(void) {
+  int c = input.peek();
+  while (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+    input.consume(1);
+    c = input.peek();
+  }
+  if (c < 0)
+    return 0;
+  const bool negative = c == '-';
+  if (negative) {
+    input.consume(1);
+    c = input.peek();
+  }
+  if (c < '0' || c > '9')
+    runtime_error("read_int: integer expected");
+  const uint32_t limit = negative ? 2147483648U : 2147483647U;
+  uint32_t value = 0;
+  do {
+    const uint32_t digit = c - '0';
+    if (value > (limit - digit) / 10)
+      runtime_error("read_int: integer out of range");
+    value = value * 10 + digit;
+    input.consume(1);
+    c = input.peek();
+  } while (c >= '0' && c <= '9');
+  return int32_t(negative ? 0U - value : value);
+}
+
+const char *__read_all(void) {
+  // The rest of a regular file is mapped rather than copied, and
+  // returned as a slice of the mapping, unless some of it is
+  // already buffered.
+  struct stat status;
+  if (!input.available() && !fstat(STDIN_FILENO, &status) &&
+      S_ISREG(status.st_mode)) {
+    const off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+    if (offset >= 0 && offset < status.st_size) {
+      const size_t size = status.st_size;
+      check_length(size - offset);
+      void *const mapping =
+          mmap(nullptr, size, PROT_READ, MAP_PRIVATE, STDIN_FILENO, 0);
+      if (mapping != MAP_FAILED) {
+        lseek(STDIN_FILENO, 0, SEEK_END);
+        string_header *const header =
+            static_cast<string_header *>(allocate(sizeof(string_header)));
+        header->bytes = static_cast<const char *>(mapping) + offset;
+        header->length = size - offset;
+        return reinterpret_cast<const char *>(header + 1);
+      }
+    }
+  }
+  std::string contents;
+  while (input.fill()) {
+    contents.append(input.data(), input.available());
+    input.consume(input.available());
+  }
+  check_length(contents.size());
+  char *const result = allocate_string(contents.size());
+  memcpy(result, contents.data(), contents.size());
+  return result;
+}
+
+} // extern "C"
+
+namespace runtime {
+
+#define PRIMITIVE(name) {#name, reinterpret_cast<void *>(&name)}
+
+const symbol symbols[] = {
+    PRIMITIVE(__print_err), PRIMITIVE(__print),     PRIMITIVE(__print_int),
+    PRIMITIVE(__flush),     PRIMITIVE(__getchar),   PRIMITIVE(__ord),
+    PRIMITIVE(__chr),       PRIMITIVE(__size),      PRIMITIVE(__substring),
+    PRIMITIVE(__concat),    PRIMITIVE(__strcmp),    PRIMITIVE(__streq),
+    PRIMITIVE(__not),       PRIMITIVE(__exit),      PRIMITIVE(__read_line),
+    PRIMITIVE(__read_int),  PRIMITIVE(__read_all),  PRIMITIVE(__getchar_code),
+    {nullptr, nullptr}};
+
+#undef PRIMITIVE
+
+const char *make_string(const char *bytes, size_t length) {
+  // Constants are never collected.
+  void *const memory = malloc(string_size(length));
+  if (!memory)
+    runtime_error("out of memory");
+  char *const s = init_string(memory, length);
+  memcpy(s, bytes, length);
+  return s;
+}
+
+int find_primitive(const std::string &name) {
+  for (int p = 0; p <= p_exit; p++)
+    if (name == symbols[p].name)
+      return p;
+  return -1;
+}
+
+} // namespace runtime
@@ -0,0 +1,109 @@
+#ifndef RUNTIME_HH
+#define RUNTIME_HH
+
+#include <cstdint>
+#include <string>
+
+// Tiger primitives, as declared by the binder and called by the
+// generated code under their external name.
+extern "C" {
+
+void __print_err(const char *s);
+void __print(const char *s);
+void __print_int(const int32_t i);
+void __flush(void);
+const char *__getchar(void);
+int32_t __ord(const char *s);
+const char *__chr(int32_t i);
+int32_t __size(const char *s);
+const char *__substring(const char *s, int32_t first, int32_t length);
+const char *__concat(const char *s1, const char *s2);
+int32_t __strcmp(const char *s1, const char *s2);
+int32_t __streq(const char *s1, const char *s2);
+int32_t __not(int32_t i);
+[[noreturn]] void __exit(int32_t status);
+
+// Input functions for read_line, read_int and read_all, which are not
+// numbered primitives, since the binder does not declare them yet.
+
+// Return the next line of the input with its newline, if any, or the
+// empty string at the end of the input.
+const char *__read_line(void);
+
+// Skip blanks, then read an optional minus sign and decimal digits
+// from the input, returning their value, or 0 at the end of the
+// input. Anything else, or a value out of range, is a runtime error.
+int32_t __read_int(void);
+
+// Return the rest of the input.
+const char *__read_all(void);
+
+// Called by the generated code for ord(getchar()): return the code
+// of the next character of the input, or -1 at its end.
+int32_t __getchar_code(void);
+
+} // extern "C"
+
+namespace runtime {
+
+// Version of the interface between the generated code and the
+// runtime, part of the keys of cached object code.
+const int abi_version = 3;
+
+// Tiger strings are immutable. A string is a pointer to the end of
+// a header holding its length and the address of its bytes, which
+// are only guaranteed to be followed by a null byte when they come
+// right after the header. They are located elsewhere for substrings,
+// which share the bytes of their parent, and are null for
+// concatenations (ropes) until they are gathered on first use. The
+// code generator lays out string literals like flat strings.
+struct string_header {
+  const char *bytes;
+  int32_t length;
+};
+
+// Return the length of a Tiger string.
+inline int32_t length(const char *s) {
+  return reinterpret_cast<const string_header *>(s)[-1].length;
+}
+
+// Return a new Tiger string holding a copy of the given bytes, which
+// is never freed.
+const char *make_string(const char *bytes, size_t length);
+
+// Name and address of every primitive, followed by the other
+// functions called by the generated code, so that in-process
+// execution engines can resolve the generated calls. The
+// table ends with a null name.
+struct symbol {
+  const char *name;
+  void *address;
+};
+
+extern const symbol symbols[];
+
+// The primitives, numbered in the order of the symbols table.
+typedef enum {
+  p_print_err = 0,
+  p_print,
+  p_print_int,
+  p_flush,
+  p_getchar,
+  p_ord,
+  p_chr,
+  p_size,
+  p_substring,
+  p_concat,
+  p_strcmp,
+  p_streq,
+  p_not,
+  p_exit
+} primitive;
+
+// Return the primitive with the given external name, or -1
+// if there is none.
+int find_primitive(const std::string &name);
+
+} // namespace runtime
+
+#endif // RUNTIME_HH
@@ -1,23 +1,89 @@
 #include <cstdlib>
 #include <iostream>
+#include <sstream>
 
 #include "errors.hh"
 
 namespace utils {
 
+namespace {
+
+thread_local Diagnostics *collected = nullptr;
+thread_local bool throwing = false;
+thread_local const std::string *location_file = nullptr;
+yy::position location_origin;
+
+// Return a position of the lexer relative to location_origin. The
+// first line of the source starts at the column of the origin, and
+// positions before it (like that of utils::nl) are left alone.
+yy::position relative(yy::position p) {
+  if (p.line < location_origin.line ||
+      (p.line == location_origin.line && p.column < location_origin.column))
+    return p;
+  if (p.line == location_origin.line)
+    p.column -= location_origin.column - 1;
+  p.line -= location_origin.line - 1;
+  return p;
+}
+
+// The prebuilt lexer leaves the file name of its locations empty, so
+// it is set here from the enclosing LocationFile.
+std::string located(yy::location l, const std::string &m) {
+  l.begin = relative(l.begin);
+  l.end = relative(l.end);
+  if (!l.begin.filename && location_file) {
+    // Locations only read their file name.
+    l.begin.filename = l.end.filename =
+        const_cast<std::string *>(location_file);
+  }
+  std::ostringstream message;
+  message << l << ": " << m;
+  return message.str();
+}
+
+} // namespace
+
+CollectDiagnostics::CollectDiagnostics(Diagnostics &diagnostics)
+    : previous(collected) {
+  collected = &diagnostics;
+}
+
+CollectDiagnostics::~CollectDiagnostics() { collected = previous; }
+
+ThrowErrors::ThrowErrors() : previous(throwing) { throwing = true; }
+
+ThrowErrors::~ThrowErrors() { throwing = previous; }
+
+LocationFile::LocationFile(const std::string &name)
+    : previous(location_file) {
+  location_file = &name;
+}
+
+LocationFile::~LocationFile() { location_file = previous; }
+
+void set_location_origin(const yy::position &origin) {
+  location_origin = origin;
+}
+
 void non_fatal_error(const yy::location &l, const std::string &m) {
-  std::cerr << l << ": " << m << std::endl;
+  non_fatal_error(located(l, m));
 }
 
-void non_fatal_error(const std::string &m) { std::cerr << m << std::endl; }
+void non_fatal_error(const std::string &m) {
+  if (collected)
+    collected->push_back(m);
+  else
+    std::cerr << m << std::endl;
+}
 
 void error(const yy::location &l, const std::string &m) {
-  non_fatal_error(l, m);
-  exit(EXIT_FAILURE);
+  error(located(l, m));
 }
 
 void error(const std::string &m) {
   non_fatal_error(m);
+  if (throwing)
+    throw Error(m);
   exit(EXIT_FAILURE);
 }
 
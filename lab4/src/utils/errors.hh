@@ -1,10 +1,68 @@
 #ifndef ERRORS_HH
 #define ERRORS_HH
 
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 #include "../parser/tiger_parser.hh"
 
 namespace utils {
 
+// Thrown by error() while a ThrowErrors object exists, once the
+// message has been reported, so that the compilation is abandoned
+// without ending the process.
+class Error : public std::runtime_error {
+public:
+  explicit Error(const std::string &m) : std::runtime_error(m) {}
+};
+
+// Messages reported by a compilation, in order.
+typedef std::vector<std::string> Diagnostics;
+
+// While it exists, store the messages reported by the current thread
+// into diagnostics instead of printing them on std::cerr.
+class CollectDiagnostics {
+  Diagnostics *const previous;
+
+public:
+  explicit CollectDiagnostics(Diagnostics &diagnostics);
+  ~CollectDiagnostics();
+  CollectDiagnostics(const CollectDiagnostics &) = delete;
+  CollectDiagnostics &operator=(const CollectDiagnostics &) = delete;
+};
+
+// While it exists, make error() on the current thread throw Error
+// instead of ending the process.
+class ThrowErrors {
+  const bool previous;
+
+public:
+  ThrowErrors();
+  ~ThrowErrors();
+  ThrowErrors(const ThrowErrors &) = delete;
+  ThrowErrors &operator=(const ThrowErrors &) = delete;
+};
+
+// While it exists, give this file name to the locations reported by
+// the current thread that have none, like those of the lexer.
+class LocationFile {
+  const std::string *const previous;
+
+public:
+  explicit LocationFile(const std::string &name);
+  ~LocationFile();
+  LocationFile(const LocationFile &) = delete;
+  LocationFile &operator=(const LocationFile &) = delete;
+};
+
+// Report locations relative to origin, the position of the lexer
+// where it started scanning the current source: the prebuilt lexer
+// never resets its position, and keeps counting lines and columns
+// from one source to the next. This is shared by the whole process,
+// like the lexer.
+void set_location_origin(const yy::position &origin);
+
 [[noreturn]] void error(const yy::location &l, const std::string &m);
 [[noreturn]] void error(const std::string &m);
 
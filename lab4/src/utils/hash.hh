@@ -0,0 +1,41 @@
+#ifndef HASH_HH
+#define HASH_HH
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace utils {
+
+// 64-bit FNV-1a hash.
+class Hash {
+  uint64_t h = 14695981039346656037ULL;
+
+public:
+  void bytes(const void *data, size_t size) {
+    const unsigned char *const p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) {
+      h ^= p[i];
+      h *= 1099511628211ULL;
+    }
+  }
+  void add(int64_t v) { bytes(&v, sizeof(v)); }
+  void add(const std::string &s) {
+    add(int64_t(s.size()));
+    bytes(s.data(), s.size());
+  }
+  void add(const Hash &other) { add(int64_t(other.h)); }
+  uint64_t value() const { return h; }
+
+  // Return the hash as 16 hexadecimal digits.
+  std::string hex() const {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx",
+             static_cast<unsigned long long>(h));
+    return buffer;
+  }
+};
+
+} // namespace utils
+
+#endif // HASH_HH
@@ -0,0 +1,141 @@
+// Write bytecode files, valid or not, and check that the loader
+// reads the former back and rejects the latter.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../../src/bytecode/bytecode.hh"
+
+using namespace bytecode;
+
+namespace {
+
+const std::string filename = "loader.tbc";
+int failures = 0;
+
+void check(bool condition, const std::string &what) {
+  if (!condition) {
+    std::cerr << "FAIL: " << what << std::endl;
+    failures++;
+  }
+}
+
+// Main stores 5 in a register and calls f, declared in main, which
+// returns its argument plus that register.
+Program valid_program() {
+  Program program;
+  program.strings = {"unused"};
+  Function main;
+  main.name = "main";
+  main.registers = 2;
+  main.code = {op_CONST, 0, 5, op_CALL, 1, 1, 0, 0, op_RETURN, 1};
+  Function f;
+  f.name = "f";
+  f.parent = 0;
+  f.params = 1;
+  f.registers = 2;
+  f.code = {op_LOAD, 1, 1, 0, op_ADD, 1, 1, 0, op_RETURN, 1};
+  program.functions = {main, f};
+  return program;
+}
+
+// Return true if loading the file ends the process with an error.
+bool rejected() {
+  const pid_t pid = fork();
+  if (pid == 0) {
+    std::freopen("/dev/null", "w", stderr);
+    load(filename);
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) != 0;
+}
+
+bool rejected(const Program &program) {
+  save(program, filename);
+  return rejected();
+}
+
+} // namespace
+
+int main() {
+  const Program program = valid_program();
+  save(program, filename);
+  const Program loaded = load(filename);
+  check(loaded.strings == program.strings, "strings are read back");
+  check(loaded.functions.size() == 2, "functions are read back");
+  for (size_t k = 0; k < loaded.functions.size(); k++) {
+    const Function &f = program.functions[k], &g = loaded.functions[k];
+    check(g.name == f.name && g.parent == f.parent && g.params == f.params &&
+              g.registers == f.registers && g.code == f.code,
+          "function " + f.name + " is read back");
+  }
+  check(run(loaded) == 10, "the program runs");
+
+  // f reads a register of main beyond main's frame, yet within its
+  // own, larger one.
+  Program p = valid_program();
+  p.functions[1].registers = 8;
+  p.functions[1].code[3] = 5;
+  check(rejected(p), "registers of enclosing frames are checked");
+
+  p = valid_program();
+  p.functions[1].code = {op_STORE, 2, 0, 0, op_RETURN, 0};
+  check(rejected(p), "static links stop at main");
+
+  p = valid_program();
+  p.functions[0].code[6] = 1;
+  check(rejected(p), "calls pass the frame of the callee's parent");
+
+  p = valid_program();
+  p.functions[0].parent = 1;
+  check(rejected(p), "main has no parent");
+
+  // The last argument, 2^31, does not fit in 32 bits.
+  p = valid_program();
+  p.functions[0].registers = INT32_MAX;
+  p.functions[0].code[7] = 1 << 30;
+  p.functions[1].params = (1 << 30) + 1;
+  p.functions[1].registers = (1 << 30) + 2;
+  check(rejected(p), "argument ranges are checked without overflowing");
+
+  p = valid_program();
+  p.functions[1].parent = 1;
+  check(rejected(p), "parents lead to main");
+
+  p = valid_program();
+  p.functions[1].parent = 2;
+  check(rejected(p), "parents are functions");
+
+  p = valid_program();
+  p.functions[0].code[3] = op_JUMP;
+  p.functions[0].code[4] = 1;
+  check(rejected(p), "jumps land on instructions");
+
+  p = valid_program();
+  p.functions[1].code = {op_PRIM, 0, 1000, 0, op_RETURN, 0};
+  check(rejected(p), "primitives are checked");
+
+  p = valid_program();
+  p.functions[1].code.pop_back();
+  check(rejected(p), "functions end with a return");
+
+  save(valid_program(), filename);
+  {
+    std::fstream file(filename, std::ios::in | std::ios::out |
+                                    std::ios::binary);
+    file.put('X');
+  }
+  check(rejected(), "the magic number is checked");
+
+  save(valid_program(), filename);
+  truncate(filename.c_str(), 30);
+  check(rejected(), "truncated files are rejected");
+
+  std::remove(filename.c_str());
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+#! /bin/sh
+# Programs read from the standard input are cached on their bytes:
+# compiling the same one twice is a hit, and a different one a miss.
+
+rm -rf stdin.cache
+program=$srcdir/codegen/for_loops.tig
+for output in stdin.1.o stdin.2.o; do
+  "$DTIGER" --cache-dir stdin.cache -o $output - < "$program" || exit 1
+done
+"$DTIGER" --cache-dir stdin.cache -o stdin.3.o - \
+  < "$srcdir/codegen/while_loops.tig" || exit 1
+if ! cmp stdin.1.o stdin.2.o; then
+  echo "the cached object differs from the compiled one"
+  exit 1
+fi
+stats=$("$DTIGER" --cache-dir stdin.cache --cache-stats) || exit 1
+if ! echo "$stats" | grep -q '^hits: 1$' ||
+   ! echo "$stats" | grep -q '^misses: 2$'; then
+  echo "unexpected cache statistics:"
+  echo "$stats"
+  exit 1
+fi
+rm -rf stdin.cache stdin.1.o stdin.2.o stdin.3.o
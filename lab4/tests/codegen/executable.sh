@@ -0,0 +1,16 @@
+#! /bin/sh
+# Executables linked without -o run like the program, and leave no
+# object file behind, not even over one next to them.
+
+echo original > executable.o
+"$DTIGER" --executable executable "$srcdir/codegen/for_loops.tig" || exit 1
+./executable > executable.out || exit 1
+if ! diff -u "$srcdir/codegen/for_loops.out" executable.out; then
+  echo "the executable does not behave like the program"
+  exit 1
+fi
+if [ "$(cat executable.o)" != original ]; then
+  echo "executable.o was overwritten"
+  exit 1
+fi
+rm -f executable executable.o executable.out
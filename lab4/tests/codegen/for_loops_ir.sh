@@ -0,0 +1,17 @@
+#! /bin/sh
+# For loops are rotated: a guard comparing the bounds, the index in
+# a phi at the top of the body, and a latch comparing it with the
+# upper bound before incrementing it, carrying the vectorizer hint
+# but no unrolling hint.
+
+. "$srcdir/ir.sh"
+generate_ir codegen/for_loops.tig
+
+expect 'br i1 %[a-z0-9]*, label %loop_body[0-9]*, label %loop_end'
+expect 'icmp sle i32'
+expect '%index[0-9]* = phi i32'
+expect 'icmp eq i32 %index'
+expect 'add nsw i32 %index[0-9]*, 1'
+expect 'br i1 %[a-z0-9]*, label %loop_end[0-9]*, label %loop_body[0-9]*, !llvm.loop'
+expect '"llvm.loop.vectorize.enable", i1 true'
+expect_count 0 '"llvm.loop.unroll'
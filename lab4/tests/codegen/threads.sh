@@ -0,0 +1,15 @@
+#! /bin/sh
+# The object code of a program generated by partitions does not
+# depend on the number of threads doing it.
+
+program=$srcdir/codegen/partitions.tig
+for option in --irgen-threads --codegen-threads; do
+  "$DTIGER" $option=1 -o threads.o "$program" || exit 1
+  mv threads.o threads.1.o
+  "$DTIGER" $option=4 -o threads.o "$program" || exit 1
+  if ! cmp threads.1.o threads.o; then
+    echo "$option: the object code depends on the number of threads"
+    exit 1
+  fi
+done
+rm -f threads.o threads.1.o
@@ -0,0 +1,11 @@
+#! /bin/sh
+# The first four while loops are rotated: their condition is tested
+# in a guard in front of the loop and at the bottom of the body. The
+# condition of the last one is too large to be generated twice, so
+# that loop jumps to its test first, and its body to the test too.
+
+. "$srcdir/ir.sh"
+generate_ir codegen/while_loops.tig
+
+expect_count 9 'br i1 .*, label %loop_body[0-9]*, label %loop_end'
+expect_count 6 'br label %loop_test[0-9]*$'
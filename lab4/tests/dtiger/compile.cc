@@ -0,0 +1,67 @@
+// Run several compilations in one process through the library, some
+// of them failing, and check that each reports its own result.
+
+#include <iostream>
+
+#include "../../src/dtiger/dtiger.hh"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &what) {
+  if (!condition) {
+    std::cerr << "FAIL: " << what << std::endl;
+    failures++;
+  }
+}
+
+} // namespace
+
+int main() {
+  dtiger::Options options;
+  options.ir = true;
+  const dtiger::Result first =
+      dtiger::compile("print_int(1 + 2)", options);
+  check(first.success, "a valid program compiles");
+  check(first.diagnostics.empty(), "a valid program reports nothing");
+  check(first.ir.find("define") != std::string::npos,
+        "the IR of the program is returned");
+
+  options.name = "undefined.tig";
+  const dtiger::Result failed =
+      dtiger::compile("print_int(undefined)", options);
+  check(!failed.success, "an undefined identifier is an error");
+  check(!failed.diagnostics.empty(), "the error is reported");
+  for (auto &message : failed.diagnostics)
+    check(message.find("undefined.tig") == 0,
+          "the error is located in its source: " + message);
+  check(failed.ir.empty(), "a failed compilation returns no IR");
+
+  // The process, and the next compilation, go on after a failure.
+  options.name = "second.tig";
+  const dtiger::Result second =
+      dtiger::compile("let var x := 4 in print_int(x * x) end", options);
+  check(second.success, "a compilation after a failure succeeds");
+  check(second.diagnostics.empty(),
+        "a compilation after a failure reports nothing");
+
+  // Errors of later compilations are located in their own source,
+  // although the lexer keeps counting from the previous ones.
+  options.name = "column.tig";
+  const dtiger::Result column = dtiger::compile("print_int(1 +)", options);
+  check(!column.success && !column.diagnostics.empty() &&
+            column.diagnostics[0].find("column.tig:1.14") == 0,
+        "a syntax error on the first line is at its column: " +
+            (column.diagnostics.empty() ? "" : column.diagnostics[0]));
+
+  options.name = "line.tig";
+  const dtiger::Result line = dtiger::compile(
+      "let\n  var x := 1\nin\n  print_int(x + y)\nend", options);
+  check(!line.success && !line.diagnostics.empty() &&
+            line.diagnostics[0].find("line.tig:4.17") == 0,
+        "an undefined identifier is at its line and column: " +
+            (line.diagnostics.empty() ? "" : line.diagnostics[0]));
+
+  return failures ? 1 : 0;
+}
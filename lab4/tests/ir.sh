@@ -0,0 +1,23 @@
+# Helpers for the scripts checking the IR generated for a program.
+
+# Set $ir to the IR generated for a Tiger program of the test tree.
+generate_ir() {
+  ir=$("$DTIGER" --irgen --dump-ir "$srcdir/$1") || exit 1
+}
+
+# Fail unless some line of the IR matches a regular expression.
+expect() {
+  if ! printf '%s\n' "$ir" | grep -q -e "$1"; then
+    echo "no match for: $1"
+    exit 1
+  fi
+}
+
+# Fail unless exactly count lines of the IR match a regular expression.
+expect_count() {
+  found=$(printf '%s\n' "$ir" | grep -c -e "$2")
+  if [ "$found" != "$1" ]; then
+    echo "$found matches instead of $1 for: $2"
+    exit 1
+  fi
+}
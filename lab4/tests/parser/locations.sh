@@ -0,0 +1,17 @@
+#! /bin/sh
+# Errors are located in the file they come from, including the
+# standard input.
+
+printf 'print_int(undefined)\n' > locations.tig
+for file in locations.tig -; do
+  if "$DTIGER" --bind "$file" < locations.tig 2> locations.err; then
+    echo "$file: an undefined identifier is accepted"
+    exit 1
+  fi
+  if ! grep -q "^$file:1\\." locations.err; then
+    echo "$file: the error is not located in the file:"
+    cat locations.err
+    exit 1
+  fi
+done
+rm -f locations.tig locations.err
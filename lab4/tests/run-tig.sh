@@ -0,0 +1,21 @@
+#! /bin/sh
+# Run a Tiger program with every execution engine of dtiger, and
+# compare what it prints with the .out file next to it. The tiered
+# engine is made to compile hot functions almost right away.
+
+test=$1
+expected=${test%.tig}.out
+output=$(basename "${test%.tig}").actual
+
+status=0
+for engine in --run --interpret --vm "--tiered --tier-threshold=2"; do
+  if ! "$DTIGER" $engine "$test" > "$output"; then
+    echo "$test: dtiger $engine failed"
+    status=1
+  elif ! diff -u "$expected" "$output"; then
+    echo "$test: unexpected output with dtiger $engine"
+    status=1
+  fi
+done
+rm -f "$output"
+exit $status
@@ -0,0 +1,151 @@
+// Read the standard input through the runtime, from a pipe and from
+// a regular file, and check what the input functions return.
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../../src/runtime/runtime.hh"
+
+namespace {
+
+const std::string filename = "input.txt";
+int failures = 0;
+
+void check(bool condition, const std::string &what) {
+  if (!condition) {
+    std::cerr << "FAIL: " << what << std::endl;
+    failures++;
+  }
+}
+
+std::string contents(const char *s) {
+  return std::string(reinterpret_cast<const runtime::string_header *>(s)[-1]
+                         .bytes,
+                     runtime::length(s));
+}
+
+// Run body in a new process whose standard input is the given input,
+// read from a pipe or from a regular file starting at offset, and
+// return its exit status. The body exits with the number of failed
+// checks.
+int run(const std::string &input, bool piped, size_t offset,
+        const std::function<void()> &body) {
+  int fds[2];
+  if (piped) {
+    if (pipe(fds))
+      return -1;
+  } else {
+    FILE *const file = std::fopen(filename.c_str(), "wb");
+    std::fwrite(input.data(), 1, input.size(), file);
+    std::fclose(file);
+    fds[0] = open(filename.c_str(), O_RDONLY);
+    lseek(fds[0], offset, SEEK_SET);
+  }
+  const pid_t pid = fork();
+  if (pid == 0) {
+    if (piped)
+      close(fds[1]);
+    dup2(fds[0], STDIN_FILENO);
+    close(fds[0]);
+    std::freopen("/dev/null", "w", stderr);
+    failures = 0;
+    body();
+    _exit(failures);
+  }
+  close(fds[0]);
+  if (piped) {
+    // Large inputs fill the pipe before the child reads them.
+    for (size_t written = 0; written < input.size();) {
+      const ssize_t n =
+          write(fds[1], input.data() + written, input.size() - written);
+      if (n <= 0)
+        break;
+      written += n;
+    }
+    close(fds[1]);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Check body with both kinds of standard input.
+void check_input(const std::string &what, const std::string &input,
+                 const std::function<void()> &body) {
+  check(run(input, true, 0, body) == 0, what + ", piped");
+  check(run(input, false, 0, body) == 0, what + ", from a file");
+}
+
+// Check that reading an integer from input is a runtime error.
+void check_rejected(const std::string &input) {
+  for (bool piped : {true, false})
+    check(run(input, piped, 0, [] { __read_int(); }) == EXIT_FAILURE,
+          "read_int rejects \"" + input + "\"" +
+              (piped ? ", piped" : ", from a file"));
+}
+
+} // namespace
+
+int main() {
+  check_input("read_line", "first\n\nlast", [] {
+    check(contents(__read_line()) == "first\n", "a line");
+    check(contents(__read_line()) == "\n", "an empty line");
+    check(contents(__read_line()) == "last", "a line without a newline");
+    check(contents(__read_line()).empty(), "the end of the input");
+  });
+
+  check_input("read_int", " 42\t-7\n2147483647 -2147483648 0\n", [] {
+    check(__read_int() == 42, "an integer after blanks");
+    check(__read_int() == -7, "a negative integer");
+    check(__read_int() == INT_MAX, "the largest integer");
+    check(__read_int() == INT_MIN, "the smallest integer");
+    check(__read_int() == 0, "zero");
+    check(__read_int() == 0, "the end of the input");
+  });
+  check_input("read_int and read_line", "12 apples\n", [] {
+    check(__read_int() == 12, "an integer before a word");
+    check(contents(__read_line()) == " apples\n", "the rest of the line");
+  });
+  check_rejected("-");
+  check_rejected("- 1");
+  check_rejected("apples");
+  check_rejected("2147483648");
+  check_rejected("-2147483649");
+  check_rejected("99999999999");
+
+  // Larger than the input buffer, so that it is filled several times.
+  std::string large;
+  for (int i = 0; large.size() < 200000; i++)
+    large += std::to_string(i) + "\n";
+  check_input("read_all", large, [&large] {
+    check(contents(__read_all()) == large, "the whole input");
+    check(contents(__read_all()).empty(), "nothing after the end");
+  });
+  check_input("read_all after read_line", large, [&large] {
+    check(contents(__read_line()) == "0\n", "the first line");
+    check(contents(__read_all()) == large.substr(2), "the rest of the input");
+  });
+
+  // Regular files are mapped rather than copied, from their offset.
+  check(run(large, false, 10, [&large] {
+          const char *const all = __read_all();
+          check(reinterpret_cast<const runtime::string_header *>(all)[-1]
+                        .bytes != all,
+                "a regular file is mapped");
+          check(contents(all) == large.substr(10), "the mapped file");
+          check(contents(__read_all()).empty(), "nothing after the mapping");
+          check(__read_int() == 0, "no integer after the mapping");
+        }) == 0,
+        "read_all maps regular files");
+
+  unlink(filename.c_str());
+  return failures ? 1 : 0;
+}